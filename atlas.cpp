@@ -0,0 +1,312 @@
+#include "atlas.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <stb_image.h>
+#include <stb_image_write.h>
+#include "state.hpp"
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <imstb_rectpack.h>
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        constexpr char atlas_magic[8] = { 'A', 'W', 'E', 'A', 'T', 'L', 'A', 'S' };
+        constexpr std::uint32_t atlas_version = 1;
+        // Empty pixels between the sprites so filtering doesn't bleed into the neighbours
+        constexpr int atlas_padding = 1;
+        constexpr int atlas_max_size = 8192;
+
+        struct sprite_file
+        {
+            std::string name;
+            std::uint64_t size = 0;
+            std::int64_t mtime = 0;
+
+            bool operator==(const sprite_file&) const = default;
+        };
+
+        // Sorted by name, the sprites are packed in this order
+        std::vector<std::pair<sprite_file, std::filesystem::path>> list_sprites(const std::filesystem::path& dir)
+        {
+            std::vector<std::pair<sprite_file, std::filesystem::path>> files;
+            std::error_code ec;
+            for(auto& de : std::filesystem::directory_iterator(dir, ec))
+            {
+                if(de.path().extension() != ".png" || !de.is_regular_file(ec))
+                    continue;
+                sprite_file f;
+                f.name = de.path().stem().string();
+                f.size = de.file_size(ec);
+                if(ec)
+                    continue;
+                auto mtime = de.last_write_time(ec);
+                if(ec)
+                    continue;
+                f.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+                files.emplace_back(std::move(f), de.path());
+            }
+            std::sort(files.begin(), files.end(), [](auto& lhs, auto& rhs) { return lhs.first.name < rhs.first.name; });
+            return files;
+        }
+
+        struct stbi_deleter
+        {
+            void operator()(unsigned char* p) const noexcept { stbi_image_free(p); }
+        };
+        using stbi_pixels = std::unique_ptr<unsigned char, stbi_deleter>;
+
+        atlas_image pack_sprites(const std::vector<std::pair<sprite_file, std::filesystem::path>>& files)
+        {
+            struct decoded
+            {
+                int w = 0, h = 0;
+                stbi_pixels pixels;
+            };
+            std::vector<decoded> images(files.size());
+            std::vector<stbrp_rect> rects(files.size());
+            std::uint64_t area = 0;
+            for(std::size_t i = 0; i < files.size(); ++i)
+            {
+                int channels = 0;
+                auto& img = images[i];
+                img.pixels.reset(stbi_load(files[i].second.string().c_str(), &img.w, &img.h, &channels, 4));
+                if(!img.pixels)
+                    throw std::runtime_error("failed to load " + files[i].second.string() + ": " + stbi_failure_reason());
+                if(img.w + atlas_padding > atlas_max_size || img.h + atlas_padding > atlas_max_size)
+                    throw std::runtime_error(files[i].second.string() + " is larger than the atlas");
+
+                rects[i].id = static_cast<int>(i);
+                rects[i].w = static_cast<stbrp_coord>(img.w + atlas_padding);
+                rects[i].h = static_cast<stbrp_coord>(img.h + atlas_padding);
+                area += static_cast<std::uint64_t>(rects[i].w) * rects[i].h;
+            }
+
+            // The smallest power of two sizes the sprites fit in,
+            // growing the width and the height in turn
+            int width = 64, height = 64;
+            auto grow = [&] {
+                if(width < height)
+                    width *= 2;
+                else
+                    height *= 2;
+            };
+            while(static_cast<std::uint64_t>(width) * height < area && height < atlas_max_size)
+                grow();
+            std::vector<stbrp_node> nodes;
+            for(;; grow())
+            {
+                if(height > atlas_max_size)
+                    throw std::runtime_error("the sprites don't fit in a " + std::to_string(atlas_max_size) + " pixels atlas");
+                nodes.resize(width);
+                stbrp_context ctx;
+                stbrp_init_target(&ctx, width, height, nodes.data(), static_cast<int>(nodes.size()));
+                if(stbrp_pack_rects(&ctx, rects.data(), static_cast<int>(rects.size())))
+                    break;
+            }
+
+            atlas_image atlas;
+            atlas.width = width;
+            atlas.height = height;
+            atlas.pixels.assign(static_cast<std::size_t>(width) * height * 4, 0);
+            for(auto& r : rects)
+            {
+                auto& img = images[r.id];
+                const std::size_t row = static_cast<std::size_t>(img.w) * 4;
+                for(int y = 0; y < img.h; ++y)
+                {
+                    std::memcpy(
+                        atlas.pixels.data() + ((static_cast<std::size_t>(r.y) + y) * width + r.x) * 4,
+                        img.pixels.get() + y * row,
+                        row
+                    );
+                }
+                atlas.sprites.emplace(files[r.id].first.name, SDL_Rect{ r.x, r.y, img.w, img.h });
+            }
+
+            return atlas;
+        }
+
+        state_buffer read_file(const std::filesystem::path& path)
+        {
+            state_buffer buf;
+            std::ifstream ifs(path, std::ios::binary);
+            std::transform(
+                std::istreambuf_iterator<char>(ifs),
+                std::istreambuf_iterator<char>(),
+                std::back_inserter(buf),
+                [](char c) { return static_cast<std::byte>(c); }
+            );
+            return buf;
+        }
+
+        // Nullopt if the cache is missing, damaged or was made from other files
+        std::optional<atlas_image> load_atlas_cache(
+            const std::filesystem::path& cache_dir,
+            const std::vector<std::pair<sprite_file, std::filesystem::path>>& files
+        ) {
+            auto buf = read_file(cache_dir / "atlas.uv");
+            if(buf.empty())
+                return std::nullopt;
+
+            atlas_image atlas;
+            try
+            {
+                state_reader r(buf);
+                char magic[8];
+                r.read_bytes(magic, sizeof(magic));
+                if(!std::equal(std::begin(magic), std::end(magic), atlas_magic))
+                    return std::nullopt;
+                if(r.read<std::uint32_t>() != atlas_version)
+                    return std::nullopt;
+                if(r.read<std::uint64_t>() != files.size())
+                    return std::nullopt;
+                atlas.width = r.read<std::int32_t>();
+                atlas.height = r.read<std::int32_t>();
+                for(auto& [expected, path] : files)
+                {
+                    sprite_file f;
+                    auto name_size = r.read<std::uint32_t>();
+                    if(name_size > r.remaining())
+                        return std::nullopt;
+                    f.name.resize(name_size);
+                    r.read_bytes(f.name.data(), f.name.size());
+                    f.size = r.read<std::uint64_t>();
+                    f.mtime = r.read<std::int64_t>();
+                    if(f != expected)
+                        return std::nullopt;
+
+                    SDL_Rect rect;
+                    rect.x = r.read<std::int32_t>();
+                    rect.y = r.read<std::int32_t>();
+                    rect.w = r.read<std::int32_t>();
+                    rect.h = r.read<std::int32_t>();
+                    if(rect.x < 0 || rect.y < 0 || rect.w < 0 || rect.h < 0 || rect.x + rect.w > atlas.width || rect.y + rect.h > atlas.height)
+                        return std::nullopt;
+                    atlas.sprites.emplace(std::move(f.name), rect);
+                }
+            }
+            catch(const std::out_of_range&)
+            {
+                return std::nullopt;
+            }
+
+            int w = 0, h = 0, channels = 0;
+            stbi_pixels pixels(stbi_load((cache_dir / "atlas.tga").string().c_str(), &w, &h, &channels, 4));
+            if(!pixels || w != atlas.width || h != atlas.height)
+                return std::nullopt;
+            atlas.pixels.assign(pixels.get(), pixels.get() + static_cast<std::size_t>(w) * h * 4);
+            atlas.from_cache = true;
+            return atlas;
+        }
+
+        // Written to temporary files first like the save states,
+        // the atlas is still used when the cache can't be written
+        void save_atlas_cache(
+            const std::filesystem::path& cache_dir,
+            const std::vector<std::pair<sprite_file, std::filesystem::path>>& files,
+            const atlas_image& atlas
+        ) {
+            std::error_code ec;
+            std::filesystem::create_directories(cache_dir, ec);
+            if(ec)
+                return;
+
+            state_buffer buf;
+            state_writer w(buf);
+            w.write_bytes(atlas_magic, sizeof(atlas_magic));
+            w.write<std::uint32_t>(atlas_version);
+            w.write<std::uint64_t>(files.size());
+            w.write<std::int32_t>(atlas.width);
+            w.write<std::int32_t>(atlas.height);
+            for(auto& [f, path] : files)
+            {
+                const SDL_Rect& rect = atlas.sprites.at(f.name);
+                w.write<std::uint32_t>(static_cast<std::uint32_t>(f.name.size()));
+                w.write_bytes(f.name.data(), f.name.size());
+                w.write<std::uint64_t>(f.size);
+                w.write<std::int64_t>(f.mtime);
+                w.write<std::int32_t>(rect.x);
+                w.write<std::int32_t>(rect.y);
+                w.write<std::int32_t>(rect.w);
+                w.write<std::int32_t>(rect.h);
+            }
+
+            // The image first, a new table never refers to an old image
+            auto image_tmp = cache_dir / "atlas.tga.tmp";
+            stbi_write_tga_with_rle = 0;
+            if(!stbi_write_tga(image_tmp.string().c_str(), atlas.width, atlas.height, 4, atlas.pixels.data()))
+                return;
+            auto uv_tmp = cache_dir / "atlas.uv.tmp";
+            {
+                std::ofstream ofs(uv_tmp, std::ios::binary);
+                ofs.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+                if(!ofs)
+                    return;
+            }
+            std::filesystem::rename(image_tmp, cache_dir / "atlas.tga", ec);
+            if(ec)
+                return;
+            std::filesystem::rename(uv_tmp, cache_dir / "atlas.uv", ec);
+        }
+    }
+
+    atlas_image load_atlas_image(const std::filesystem::path& dir, const std::filesystem::path& cache_dir)
+    {
+        auto files = detailed::list_sprites(dir);
+        if(files.empty())
+            return {};
+        if(!cache_dir.empty())
+        {
+            if(auto cached = detailed::load_atlas_cache(cache_dir, files))
+                return std::move(*cached);
+        }
+
+        auto atlas = detailed::pack_sprites(files);
+        if(!cache_dir.empty())
+            detailed::save_atlas_cache(cache_dir, files, atlas);
+        return atlas;
+    }
+
+    texture_atlas::texture_atlas(SDL_Renderer* ren, const atlas_image& img)
+        : m_texture(nullptr, &SDL_DestroyTexture)
+    {
+        if(img.width <= 0 || img.height <= 0)
+            return;
+        m_texture.reset(SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, img.width, img.height));
+        if(!m_texture)
+            throw std::runtime_error(std::string("failed to create the atlas texture: ") + SDL_GetError());
+        if(SDL_UpdateTexture(m_texture.get(), nullptr, img.pixels.data(), img.width * 4) != 0)
+            throw std::runtime_error(std::string("failed to upload the atlas: ") + SDL_GetError());
+        SDL_SetTextureBlendMode(m_texture.get(), SDL_BLENDMODE_BLEND);
+
+        const float w = static_cast<float>(img.width);
+        const float h = static_cast<float>(img.height);
+        for(auto& [name, rect] : img.sprites)
+            m_uvs.emplace(name, SDL_FRect{ rect.x / w, rect.y / h, rect.w / w, rect.h / h });
+    }
+
+    std::optional<SDL_FRect> texture_atlas::find(std::string_view name) const
+    {
+        if(auto it = m_uvs.find(name); it != m_uvs.end())
+            return it->second;
+        return std::nullopt;
+    }
+
+    std::filesystem::path sprite_directory()
+    {
+        return "sprites";
+    }
+    std::filesystem::path atlas_cache_directory(const std::filesystem::path& dir)
+    {
+        return dir / "cache";
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <SDL.h>
+
+
+namespace awe
+{
+    //  The sprites of a directory packed into one RGBA image.
+    //  Every .png file of the directory is a sprite named after its stem.
+    //  The packed image and the rectangles of the sprites are cached to
+    //  another directory together with the names, sizes and modification
+    //  times of the files, a later load with the same files reads the cache
+    //  instead of decoding and packing each sprite again.
+    struct atlas_image
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<unsigned char> pixels; // RGBA, width * 4 bytes per row
+        std::map<std::string, SDL_Rect, std::less<>> sprites; // in pixels
+        bool from_cache = false;
+    };
+
+    // Empty if dir has no sprites, an empty cache_dir disables the cache.
+    // Throws if a sprite can't be decoded or the sprites don't fit in the largest atlas.
+    atlas_image load_atlas_image(const std::filesystem::path& dir, const std::filesystem::path& cache_dir);
+
+    //  An atlas image uploaded to a renderer
+    class texture_atlas
+    {
+    public:
+        texture_atlas(SDL_Renderer* ren, const atlas_image& img);
+
+        SDL_Texture* texture() const noexcept { return m_texture.get(); }
+        // Normalized texture coordinates, nullopt if no sprite has this name
+        std::optional<SDL_FRect> find(std::string_view name) const;
+
+    private:
+        std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> m_texture;
+        std::map<std::string, SDL_FRect, std::less<>> m_uvs;
+    };
+
+    std::filesystem::path sprite_directory();
+    // Where the atlas of the sprites of dir is cached
+    std::filesystem::path atlas_cache_directory(const std::filesystem::path& dir);
+}
@@ -0,0 +1,50 @@
+#include "broadphase.hpp"
+
+
+namespace awe
+{
+    uniform_grid::uniform_grid(q16_16 world_size, int cell_bits)
+        : m_cell_bits(cell_bits)
+    {
+        m_side = static_cast<std::uint32_t>((world_size.to_int() >> cell_bits) + 1);
+        m_cells.resize(static_cast<std::size_t>(m_side) * m_side);
+    }
+
+    void uniform_grid::insert(std::uint32_t id, q16_16 x, q16_16 y)
+    {
+        if(id >= m_cell_of.size())
+            m_cell_of.resize(id + 1, no_cell);
+        else if(m_cell_of[id] != no_cell)
+            remove(id);
+
+        std::uint32_t c = cell_index(x, y);
+        auto& cell = m_cells[c];
+        cell.insert(std::lower_bound(cell.begin(), cell.end(), id), id);
+        m_cell_of[id] = c;
+    }
+
+    void uniform_grid::remove(std::uint32_t id)
+    {
+        if(id >= m_cell_of.size() || m_cell_of[id] == no_cell)
+            return;
+        auto& cell = m_cells[m_cell_of[id]];
+        auto it = std::lower_bound(cell.begin(), cell.end(), id);
+        if(it != cell.end() && *it == id)
+            cell.erase(it);
+        m_cell_of[id] = no_cell;
+    }
+
+    void uniform_grid::update(std::uint32_t id, q16_16 x, q16_16 y)
+    {
+        if(id < m_cell_of.size() && m_cell_of[id] == cell_index(x, y))
+            return;
+        insert(id, x, y);
+    }
+
+    void uniform_grid::clear()
+    {
+        for(auto& cell : m_cells)
+            cell.clear();
+        m_cell_of.clear();
+    }
+}
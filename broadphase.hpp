@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "fixed.hpp"
+
+
+namespace awe
+{
+    //  Uniform grid over the square [0, world_size] for collision and
+    //  proximity queries. Objects are identified by stable ids (entity slots).
+    //  Every cell keeps its ids sorted, so the iteration order only depends on
+    //  the current positions and not on the history of insertions. Rolling
+    //  back and resimulating therefore visits pairs in the same order.
+    class uniform_grid
+    {
+    public:
+        static constexpr std::uint32_t no_cell = std::numeric_limits<std::uint32_t>::max();
+
+        // The cell size is 2^cell_bits world units
+        uniform_grid(q16_16 world_size, int cell_bits);
+
+        void insert(std::uint32_t id, q16_16 x, q16_16 y);
+        void remove(std::uint32_t id);
+        // Only touches the cells if the object crossed a cell border
+        void update(std::uint32_t id, q16_16 x, q16_16 y);
+        void clear();
+
+        q16_16 cell_size() const noexcept { return q16_16(1 << m_cell_bits); }
+        std::uint32_t cells_per_side() const noexcept { return m_side; }
+
+        //  Calls f(a, b) once for every pair of ids in the same or in
+        //  neighbouring cells. Cells are visited in row-major order.
+        template <typename F>
+        void for_each_pair(F&& f) const
+        {
+            for_each_pair(0, m_side, f);
+        }
+        //  Only the pairs whose first id is in a cell of the rows [row_begin, row_end).
+        //  Visiting consecutive row ranges one after another gives the
+        //  same sequence as visiting all rows at once.
+        template <typename F>
+        void for_each_pair(std::uint32_t row_begin, std::uint32_t row_end, F&& f) const
+        {
+            // Half of the neighbourhood, so each pair of cells is seen once
+            constexpr int offsets[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+            for(std::uint32_t cy = row_begin; cy < row_end; ++cy)
+            {
+                for(std::uint32_t cx = 0; cx < m_side; ++cx)
+                {
+                    const auto& cell = m_cells[cy * m_side + cx];
+                    if(cell.empty())
+                        continue;
+                    for(std::size_t i = 0; i < cell.size(); ++i)
+                    {
+                        for(std::size_t j = i + 1; j < cell.size(); ++j)
+                            f(cell[i], cell[j]);
+                    }
+                    for(auto& [ox, oy] : offsets)
+                    {
+                        std::int64_t nx = static_cast<std::int64_t>(cx) + ox;
+                        std::int64_t ny = static_cast<std::int64_t>(cy) + oy;
+                        if(nx < 0 || nx >= m_side || ny >= m_side)
+                            continue;
+                        const auto& other = m_cells[ny * m_side + nx];
+                        for(auto a : cell)
+                        {
+                            for(auto b : other)
+                                f(a, b);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Calls f(id) for every id in the cells overlapping the box
+        template <typename F>
+        void query(q16_16 x0, q16_16 y0, q16_16 x1, q16_16 y1, F&& f) const
+        {
+            std::uint32_t cx0 = cell_coord(x0), cy0 = cell_coord(y0);
+            std::uint32_t cx1 = cell_coord(x1), cy1 = cell_coord(y1);
+            for(std::uint32_t cy = cy0; cy <= cy1; ++cy)
+            {
+                for(std::uint32_t cx = cx0; cx <= cx1; ++cx)
+                {
+                    for(auto id : m_cells[cy * m_side + cx])
+                        f(id);
+                }
+            }
+        }
+
+    private:
+        int m_cell_bits;
+        std::uint32_t m_side;
+        std::vector<std::vector<std::uint32_t>> m_cells;
+        std::vector<std::uint32_t> m_cell_of; // indexed by id
+
+        std::uint32_t cell_coord(q16_16 v) const noexcept
+        {
+            std::int32_t c = v.raw() >> (q16_16::frac_bits + m_cell_bits);
+            return static_cast<std::uint32_t>(std::clamp<std::int32_t>(c, 0, static_cast<std::int32_t>(m_side) - 1));
+        }
+        std::uint32_t cell_index(q16_16 x, q16_16 y) const noexcept
+        {
+            return cell_coord(y) * m_side + cell_coord(x);
+        }
+    };
+}
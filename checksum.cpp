@@ -0,0 +1,137 @@
+#include "checksum.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <boost/endian.hpp>
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        std::uint64_t hash_pair(std::uint64_t a, std::uint64_t b) noexcept
+        {
+            std::array<std::byte, 16> buf;
+            boost::endian::store_little_u64(reinterpret_cast<unsigned char*>(buf.data()), a);
+            boost::endian::store_little_u64(reinterpret_cast<unsigned char*>(buf.data()) + 8, b);
+            return fnv1a(buf);
+        }
+    }
+
+    void state_hasher::mark_dirty(std::size_t begin, std::size_t end)
+    {
+        if(begin >= end)
+            return;
+        const std::size_t last = (end - 1) / page_size;
+        if(m_marked.size() <= last)
+            m_marked.resize(last + 1, 0);
+        std::fill(m_marked.begin() + begin / page_size, m_marked.begin() + last + 1, 1);
+    }
+
+    std::uint64_t state_hasher::update(std::span<const std::byte> data)
+    {
+        if(data.size() != m_shadow.size())
+        {
+            // Every page is hashed again anyway
+            m_shadow.assign(data.begin(), data.end());
+            m_all_dirty = true;
+        }
+        else
+        {
+            for(std::size_t begin = 0; begin < data.size(); begin += page_size)
+            {
+                std::size_t len = std::min(page_size, data.size() - begin);
+                if(std::memcmp(data.data() + begin, m_shadow.data() + begin, len) == 0)
+                    continue;
+                std::memcpy(m_shadow.data() + begin, data.data() + begin, len);
+                mark_dirty(begin, begin + len);
+            }
+        }
+        return update(std::span<const std::span<const std::byte>>(&data, 1));
+    }
+
+    std::uint64_t state_hasher::update(std::span<const std::span<const std::byte>> pieces)
+    {
+        std::size_t size = 0;
+        for(auto piece : pieces)
+            size += piece.size();
+        const std::size_t pages = (size + page_size - 1) / page_size;
+        const std::size_t width = std::bit_ceil(std::max<std::size_t>(pages, 1));
+
+        m_dirty.clear();
+        if(width != m_width)
+        {
+            // Different shape, the tree is built again
+            m_width = width;
+            m_nodes.assign(2 * width, 0);
+            m_pages = 0;
+            m_all_dirty = true;
+        }
+        // The pages have moved
+        if(size != m_size)
+            m_all_dirty = true;
+
+        for(std::size_t i = 0; i < std::max(pages, m_pages); ++i)
+        {
+            if(m_all_dirty || (i < m_marked.size() && m_marked[i]))
+                m_dirty.push_back(width + i);
+        }
+        m_dirty_pages = m_dirty.size();
+        m_pages = pages;
+        m_size = size;
+        m_all_dirty = false;
+        std::fill(m_marked.begin(), m_marked.end(), 0);
+
+        // The dirty pages are in order, so the pieces are walked once.
+        // Hashing a page piece by piece is the same as hashing its bytes at once.
+        std::size_t piece = 0, piece_begin = 0;
+        for(auto node : m_dirty)
+        {
+            std::size_t begin = (node - width) * page_size;
+            const std::size_t end = std::min(begin + page_size, size);
+            if(begin >= end)
+            {
+                m_nodes[node] = 0;
+                continue;
+            }
+            std::uint64_t hash = fnv1a({});
+            while(begin < end)
+            {
+                while(piece_begin + pieces[piece].size() <= begin)
+                    piece_begin += pieces[piece++].size();
+                std::size_t len = std::min(end, piece_begin + pieces[piece].size()) - begin;
+                hash = fnv1a(pieces[piece].subspan(begin - piece_begin, len), hash);
+                begin += len;
+            }
+            m_nodes[node] = hash;
+        }
+
+        // Up the tree, the dirty nodes of a level stay sorted
+        while(!m_dirty.empty() && m_dirty.front() > 1)
+        {
+            std::size_t out = 0;
+            for(std::size_t i = 0; i < m_dirty.size(); ++i)
+            {
+                std::size_t parent = m_dirty[i] / 2;
+                if(out > 0 && m_dirty[out - 1] == parent)
+                    continue;
+                // Subtrees without pages stay 0, as if they had never been touched
+                std::uint64_t l = m_nodes[2 * parent], r = m_nodes[2 * parent + 1];
+                m_nodes[parent] = l == 0 && r == 0 ? 0 : detailed::hash_pair(l, r);
+                m_dirty[out++] = parent;
+            }
+            m_dirty.resize(out);
+        }
+
+        // The size tells apart states that only differ by trailing zero pages
+        m_checksum = detailed::hash_pair(m_nodes[1], size);
+        return m_checksum;
+    }
+
+    std::uint64_t state_checksum(std::span<const std::byte> data)
+    {
+        state_hasher h;
+        return h.update(data);
+    }
+}
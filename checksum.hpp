@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "state.hpp"
+
+
+namespace awe
+{
+    //  Checksum of a serialized state, the root of a Merkle tree over
+    //  fixed-size pages. An update only hashes the pages that changed and
+    //  their ancestors in the tree, so its cost follows the amount of change
+    //  rather than the size of the state. The owner of the state marks the
+    //  bytes it writes, or lets the hasher find them by comparing with a
+    //  copy of the previous state. Use one of the two ways per hasher.
+    class state_hasher
+    {
+    public:
+        static constexpr std::size_t page_size = 4096;
+
+        // Marks bytes [begin, end) of the state as written since the last update
+        void mark_dirty(std::size_t begin, std::size_t end);
+        void mark_all_dirty() noexcept { m_all_dirty = true; }
+
+        // Returns the checksum of the pieces put end to end. Only the marked
+        // pages are hashed, all of them when the size changed.
+        std::uint64_t update(std::span<const std::span<const std::byte>> pieces);
+        // Returns the checksum of data, for states that are only at hand serialized.
+        // The changed pages are found by comparing with the previous data.
+        std::uint64_t update(std::span<const std::byte> data);
+
+        std::uint64_t checksum() const noexcept { return m_checksum; }
+        std::size_t page_count() const noexcept { return m_pages; }
+        // Pages hashed by the last update
+        std::size_t dirty_pages() const noexcept { return m_dirty_pages; }
+
+    private:
+        state_buffer m_shadow;
+        // Complete binary tree, m_nodes[1] is the root and the leaves start
+        // at m_width. Leaves without a page are 0.
+        std::vector<std::uint64_t> m_nodes;
+        std::vector<std::uint8_t> m_marked; // by page
+        bool m_all_dirty = true;
+        std::size_t m_width = 0;
+        std::size_t m_size = 0;
+        std::size_t m_pages = 0;
+        std::size_t m_dirty_pages = 0;
+        std::uint64_t m_checksum = 0;
+        std::vector<std::size_t> m_dirty; // scratch
+    };
+
+    // The same checksum without the incremental state
+    std::uint64_t state_checksum(std::span<const std::byte> data);
+}
@@ -0,0 +1,916 @@
+#include "cli.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "atlas.hpp"
+#include "checksum.hpp"
+#include "desync.hpp"
+#include "fuzz.hpp"
+#include "input_source.hpp"
+#include "random.hpp"
+#include "replay.hpp"
+#include "replay_export.hpp"
+#include "replay_library.hpp"
+#include "runner.hpp"
+#include "savestate.hpp"
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        // "random", "script:<file>" or "record:<file>"
+        std::unique_ptr<input_source> make_input_source(std::string_view spec, std::uint64_t seed)
+        {
+            if(spec == "random")
+                return std::make_unique<random_input_source>(seed);
+            if(spec.starts_with("script:"))
+                return std::make_unique<scripted_input_source>(std::string(spec.substr(7)));
+            if(spec.starts_with("record:"))
+                return std::make_unique<recorded_input_source>(std::string(spec.substr(7)));
+            throw std::invalid_argument("unknown input source " + std::string(spec));
+        }
+
+        // Quoted and escaped for JSON
+        std::string json_string(std::string_view str)
+        {
+            std::string out = "\"";
+            for(char c : str)
+            {
+                if(c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += c;
+                }
+                else if(static_cast<unsigned char>(c) < 0x20)
+                {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned int>(c));
+                    out += buf;
+                }
+                else
+                    out += c;
+            }
+            out += '"';
+            return out;
+        }
+
+        // Re-encodes the inputs of every chunk of a replay in each encoding
+        // and prints the sizes and the encode and decode throughput
+        void print_input_codecs(const replay_file& file)
+        {
+            constexpr int repeats = 20;
+            const std::uint32_t players = file.info().players;
+
+            std::vector<std::vector<frame_input>> chunks(file.chunk_count());
+            std::uint64_t stored = 0;
+            for(std::size_t i = 0; i < chunks.size(); ++i)
+            {
+                file.read_inputs(i, chunks[i]);
+                stored += file.chunk(i).inputs.size();
+            }
+            std::printf(
+                "  inputs: %llu bytes stored for %llu frames\n",
+                static_cast<unsigned long long>(stored),
+                static_cast<unsigned long long>(file.frames())
+            );
+
+            using clock = std::chrono::steady_clock;
+            std::vector<std::byte> encoded, rle;
+            std::vector<frame_input> decoded;
+            for(auto [encoding, name] : {
+                std::pair(replay_encoding::raw, "raw"),
+                std::pair(replay_encoding::packed_rle, "packed+RLE"),
+                std::pair(replay_encoding::packed_rle_lz, "packed+RLE+LZ")
+            }) {
+                std::uint64_t size = 0;
+                clock::duration encode_time{}, decode_time{};
+                for(auto& inputs : chunks)
+                {
+                    for(int r = 0; r < repeats; ++r)
+                    {
+                        auto start = clock::now();
+                        encoded.clear();
+                        if(encoding == replay_encoding::raw)
+                        {
+                            for(auto& input : inputs)
+                            {
+                                auto* keys = reinterpret_cast<const std::byte*>(input.keys.data());
+                                encoded.insert(encoded.end(), keys, keys + players);
+                            }
+                        }
+                        else
+                        {
+                            rle.clear();
+                            input_encoder enc(rle, players);
+                            for(auto& input : inputs)
+                                enc.add(input);
+                            enc.flush();
+                            if(encoding == replay_encoding::packed_rle_lz)
+                                lz_compress(rle, encoded);
+                            else
+                                encoded.swap(rle);
+                        }
+                        auto mid = clock::now();
+                        decoded.clear();
+                        decode_inputs(encoded, encoding, players, inputs.size(), decoded);
+                        auto end = clock::now();
+                        encode_time += mid - start;
+                        decode_time += end - mid;
+                    }
+                    if(decoded != inputs)
+                        throw std::runtime_error(std::string(name) + " doesn't decode to the recorded inputs");
+                    size += encoded.size();
+                }
+
+                auto mframes_per_s = [&](clock::duration d)
+                {
+                    double s = std::chrono::duration<double>(d).count();
+                    return s == 0 ? 0.0 : file.frames() * static_cast<double>(repeats) / s / 1e6;
+                };
+                std::printf(
+                    "    %-14s %8llu bytes, encode %8.1f Mframes/s, decode %8.1f Mframes/s\n",
+                    name,
+                    static_cast<unsigned long long>(size),
+                    mframes_per_s(encode_time),
+                    mframes_per_s(decode_time)
+                );
+            }
+        }
+    }
+
+    command_line::command_line(int argc, char* argv[])
+    {
+        for(int i = 1; i < argc; ++i)
+            m_args.emplace_back(argv[i]);
+    }
+
+    bool command_line::has(std::string_view opt) const
+    {
+        return std::find(m_args.begin(), m_args.end(), opt) != m_args.end();
+    }
+    std::optional<std::string_view> command_line::get(std::string_view opt) const
+    {
+        auto it = std::find(m_args.begin(), m_args.end(), opt);
+        if(it == m_args.end() || ++it == m_args.end())
+            return std::nullopt;
+        return *it;
+    }
+    std::uint64_t command_line::get_uint(std::string_view opt, std::uint64_t def) const
+    {
+        auto str = get(opt);
+        if(!str)
+            return def;
+        std::uint64_t val = 0;
+        auto [ptr, ec] = std::from_chars(str->data(), str->data() + str->size(), val);
+        if(ec != std::errc() || ptr != str->data() + str->size())
+            throw std::invalid_argument("invalid value for " + std::string(opt));
+        return val;
+    }
+
+    std::optional<int> run_tool(int argc, char* argv[])
+    {
+        command_line cmd(argc, argv);
+        try
+        {
+            if(cmd.command() == "--synctest")
+                return run_synctest(cmd);
+            if(cmd.command() == "--desync-diff")
+                return run_desync_diff(cmd);
+            if(cmd.command() == "--headless")
+                return run_headless(cmd);
+            if(cmd.command() == "--fuzz")
+                return run_fuzz(cmd);
+            if(cmd.command() == "--parallel-check")
+                return run_parallel_check(cmd);
+            if(cmd.command() == "--parallel-bench")
+                return run_parallel_bench(cmd);
+            if(cmd.command() == "--checksum-bench")
+                return run_checksum_bench(cmd);
+            if(cmd.command() == "--resume-check")
+                return run_resume_check(cmd);
+            if(cmd.command() == "--replay")
+                return run_replay(cmd);
+            if(cmd.command() == "--replay-bench")
+                return run_replay_bench(cmd);
+            if(cmd.command() == "--replay-export")
+                return run_replay_export(cmd);
+            if(cmd.command() == "--replay-list")
+                return run_replay_list(cmd);
+            if(cmd.command() == "--atlas")
+                return run_atlas(cmd);
+        }
+        catch(const std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return EXIT_FAILURE;
+        }
+
+        return std::nullopt;
+    }
+
+    // kairos --synctest [--frames N] [--check-distance N] [--seed N] [--entities N]
+    int run_synctest(const command_line& cmd)
+    {
+        auto frames = cmd.get_uint("--frames", 10000);
+        auto entities = cmd.get_uint("--entities", 256);
+        auto distance = static_cast<unsigned int>(cmd.get_uint("--check-distance", 8));
+        auto seed = static_cast<unsigned int>(cmd.get_uint("--seed", std::random_device()()));
+
+        synctest_runner st(seed, distance);
+        st.game()->spawn_entities(entities);
+        random_input_source input(seed);
+
+        auto start = std::chrono::steady_clock::now();
+        for(std::uint64_t i = 0; i < frames; ++i)
+        {
+            if(!st.tick(*input.next()))
+                break;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if(auto frame = st.desync_frame())
+        {
+            std::printf(
+                "synctest: desync at frame %llu (seed %u, check distance %u)\n",
+                static_cast<unsigned long long>(*frame),
+                seed,
+                distance
+            );
+            return EXIT_FAILURE;
+        }
+
+        std::printf(
+            "synctest: %llu frames OK (seed %u, check distance %u, %.0f frames/s)\n",
+            static_cast<unsigned long long>(frames),
+            seed,
+            distance,
+            elapsed.count() > 0 ? frames / elapsed.count() : 0.0
+        );
+        return EXIT_SUCCESS;
+    }
+
+    // kairos --desync-diff A B
+    int run_desync_diff(const command_line& cmd)
+    {
+        if(cmd.arg(1).empty() || cmd.arg(2).empty())
+            throw std::invalid_argument("usage: kairos --desync-diff <dump A> <dump B>");
+        auto a = desync_dump::load(std::string(cmd.arg(1)));
+        auto b = desync_dump::load(std::string(cmd.arg(2)));
+
+        return diff_dumps(a, b, stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    // kairos --headless [--frames N] [--seed N] [--entities N] [--threads N]
+    //     [--input random|script:FILE|record:FILE] [--record-inputs FILE] [--record-replay FILE]
+    int run_headless(const command_line& cmd)
+    {
+        auto frames = cmd.get_uint("--frames", 3600);
+        auto seed = static_cast<unsigned int>(cmd.get_uint("--seed", std::random_device()()));
+        auto entities = cmd.get_uint("--entities", 10000);
+        auto threads = static_cast<unsigned int>(cmd.get_uint("--threads", 1));
+        auto input_spec = cmd.get("--input").value_or("random");
+
+        headless_runner hr(seed, detailed::make_input_source(input_spec, seed));
+        hr.game()->spawn_entities(entities);
+        if(threads > 1)
+            hr.game()->set_thread_pool(std::make_shared<thread_pool>(threads));
+
+        std::optional<input_log_writer> log;
+        if(auto path = cmd.get("--record-inputs"))
+        {
+            log.emplace(std::string(*path));
+            hr.on_input.connect([&log](const frame_input& input) { log->write(input); });
+        }
+        std::optional<replay_recorder> rec;
+        state_buffer keyframe;
+        if(auto path = cmd.get("--record-replay"))
+        {
+            rec.emplace(std::string(*path), replay_info{ seed, max_players, entities });
+            hr.on_input.connect([&rec, &keyframe, &hr](const frame_input& input) {
+                rec->record(input);
+                if(rec->wants_keyframe())
+                {
+                    hr.game()->save_state(keyframe);
+                    rec->record_keyframe(keyframe);
+                }
+            });
+        }
+
+        hr.run(frames);
+        if(rec)
+        {
+            rec->set_checksum(hr.game()->checksum());
+            rec->close();
+            if(rec->failed())
+                throw std::runtime_error("failed to write the replay");
+        }
+
+        const auto& stats = hr.stats();
+        auto us = [&stats](double p) { return stats.percentile(p) / 1000.0; };
+        std::printf(
+            "headless: %zu ticks, %llu entities, seed %u\n"
+            "  %.1f ticks/s\n"
+            "  tick latency (us): p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n"
+            "  final checksum %016llx\n",
+            stats.count(),
+            static_cast<unsigned long long>(entities),
+            seed,
+            stats.ticks_per_second(),
+            us(50), us(90), us(99), us(99.9), us(100),
+            static_cast<unsigned long long>(hr.game()->checksum())
+        );
+        return EXIT_SUCCESS;
+    }
+
+    // kairos --fuzz [--threads N] [--cases N] [--duration SECONDS] [--seed N]
+    //     [--frames N] [--entities N] [--max-latency N] [--input-delay N] [--speculate]
+    // kairos --fuzz --case SEED [...]
+    int run_fuzz(const command_line& cmd)
+    {
+        fuzz_options opts;
+        opts.frames = cmd.get_uint("--frames", opts.frames);
+        opts.entities = cmd.get_uint("--entities", opts.entities);
+        opts.max_latency = static_cast<unsigned int>(cmd.get_uint("--max-latency", opts.max_latency));
+        opts.input_delay = static_cast<unsigned int>(cmd.get_uint("--input-delay", opts.input_delay));
+        opts.speculate = cmd.has("--speculate");
+
+        auto print_failure = [](const fuzz_failure& f) {
+            std::printf(
+                f.kind == "stall" ? "fuzz: %s at frame %llu (case %u)\n" : "fuzz: %s mismatch at frame %llu (case %u)\n",
+                f.kind.c_str(),
+                static_cast<unsigned long long>(f.frame),
+                f.seed
+            );
+            std::fflush(stdout);
+        };
+
+        if(cmd.has("--case"))
+        {
+            auto seed = static_cast<unsigned int>(cmd.get_uint("--case", 0));
+            if(auto failure = fuzz_case(seed, opts))
+            {
+                print_failure(*failure);
+                return EXIT_FAILURE;
+            }
+            std::printf("fuzz: case %u OK\n", seed);
+            return EXIT_SUCCESS;
+        }
+
+        auto threads = static_cast<unsigned int>(cmd.get_uint("--threads", std::max(std::thread::hardware_concurrency(), 1u)));
+        auto cases = cmd.get_uint("--cases", 0);
+        auto duration = cmd.get_uint("--duration", cases == 0 ? 60 : 0);
+        auto seed = cmd.get_uint("--seed", std::random_device()());
+
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        if(duration != 0)
+            deadline = std::chrono::steady_clock::now() + std::chrono::seconds(duration);
+
+        fuzz_harness harness(opts);
+        harness.on_failure.connect(print_failure);
+        auto start = std::chrono::steady_clock::now();
+        harness.run(seed, cases, threads, deadline);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        auto failures = harness.failures();
+        std::printf(
+            "fuzz: %llu cases, %zu failed (seed %llu, %u threads, %.1f cases/s)\n",
+            static_cast<unsigned long long>(harness.cases_run()),
+            failures.size(),
+            static_cast<unsigned long long>(seed),
+            threads,
+            elapsed.count() > 0 ? harness.cases_run() / elapsed.count() : 0.0
+        );
+        return failures.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // kairos --parallel-check [--seeds N] [--seed N] [--frames N] [--entities N] [--threads N]
+    // Runs the synctest corpus with the entity systems on a thread pool and
+    // compares the checksum of every frame with a single-threaded world
+    int run_parallel_check(const command_line& cmd)
+    {
+        auto seeds = cmd.get_uint("--seeds", 8);
+        auto first_seed = static_cast<unsigned int>(cmd.get_uint("--seed", 0));
+        auto frames = cmd.get_uint("--frames", 1000);
+        auto entities = cmd.get_uint("--entities", 8192);
+        auto threads = static_cast<unsigned int>(cmd.get_uint("--threads", std::max(std::thread::hardware_concurrency(), 2u)));
+
+        auto pool = std::make_shared<thread_pool>(threads);
+        for(std::uint64_t n = 0; n < seeds; ++n)
+        {
+            const unsigned int seed = first_seed + static_cast<unsigned int>(n);
+            game_world serial(seed);
+            serial.spawn_entities(entities);
+            synctest_runner parallel(seed, 8);
+            parallel.game()->spawn_entities(entities);
+            parallel.game()->set_thread_pool(pool);
+            random_input_source input(seed);
+
+            for(std::uint64_t f = 0; f < frames; ++f)
+            {
+                auto keys = *input.next();
+                serial.apply_input(keys);
+                serial.update();
+                if(!parallel.tick(keys) || serial.checksum() != parallel.game()->checksum())
+                {
+                    std::printf(
+                        "parallel-check: mismatch at frame %llu (seed %u, %u threads)\n",
+                        static_cast<unsigned long long>(f),
+                        seed,
+                        threads
+                    );
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        std::printf(
+            "parallel-check: %llu seeds x %llu frames identical (%u threads, %llu entities)\n",
+            static_cast<unsigned long long>(seeds),
+            static_cast<unsigned long long>(frames),
+            threads,
+            static_cast<unsigned long long>(entities)
+        );
+        return EXIT_SUCCESS;
+    }
+
+    // kairos --parallel-bench [--threads N] [--frames N] [--entities N] [--seed N]
+    // Ticks the same world with 1 to N threads
+    int run_parallel_bench(const command_line& cmd)
+    {
+        auto max_threads = static_cast<unsigned int>(cmd.get_uint("--threads", std::max(std::thread::hardware_concurrency(), 1u)));
+        auto frames = cmd.get_uint("--frames", 600);
+        auto entities = cmd.get_uint("--entities", 50000);
+        auto seed = static_cast<unsigned int>(cmd.get_uint("--seed", std::random_device()()));
+
+        std::printf("threads  ticks/s  speedup  p99 (us)  checksum\n");
+        double base = 0.0;
+        for(unsigned int threads = 1; threads <= max_threads; ++threads)
+        {
+            headless_runner hr(seed, std::make_unique<random_input_source>(seed));
+            hr.game()->spawn_entities(entities);
+            if(threads > 1)
+                hr.game()->set_thread_pool(std::make_shared<thread_pool>(threads));
+            hr.run(frames);
+
+            const auto& stats = hr.stats();
+            double tps = stats.ticks_per_second();
+            if(threads == 1)
+                base = tps;
+            std::printf(
+                "%7u  %7.1f  %6.2fx  %8.1f  %016llx\n",
+                threads,
+                tps,
+                base > 0 ? tps / base : 0.0,
+                stats.percentile(99) / 1000.0,
+                static_cast<unsigned long long>(hr.game()->checksum())
+            );
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // kairos --checksum-bench [--frames N] [--entities N] [--seed N]
+    // Per-frame cost of serializing and hashing the whole state against the
+    // world's checksum, which only hashes the pages its systems wrote
+    int run_checksum_bench(const command_line& cmd)
+    {
+        auto frames = cmd.get_uint("--frames", 600);
+        auto entities = cmd.get_uint("--entities", 50000);
+        auto seed = static_cast<unsigned int>(cmd.get_uint("--seed", std::random_device()()));
+
+        game_world world(seed);
+        world.spawn_entities(entities);
+        random_input_source input(seed);
+        state_buffer state;
+        tick_stats full, incremental;
+        std::uint64_t dirty = 0;
+
+        for(std::uint64_t f = 0; f < frames; ++f)
+        {
+            world.apply_input(*input.next());
+            world.update();
+
+            auto t0 = std::chrono::steady_clock::now();
+            world.save_state(state);
+            std::uint64_t a = state_checksum(state);
+            auto t1 = std::chrono::steady_clock::now();
+            std::uint64_t b = world.checksum();
+            auto t2 = std::chrono::steady_clock::now();
+
+            if(a != b)
+            {
+                std::printf("checksum-bench: mismatch at frame %llu\n", static_cast<unsigned long long>(f));
+                return EXIT_FAILURE;
+            }
+            full.add(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            incremental.add(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+            dirty += world.hasher().dirty_pages();
+        }
+
+        std::printf(
+            "checksum-bench: %zu byte state, %zu pages, %.1f dirty per frame\n"
+            "  full:        p50 %.1f us, p99 %.1f us\n"
+            "  incremental: p50 %.1f us, p99 %.1f us\n",
+            state.size(),
+            world.hasher().page_count(),
+            frames > 0 ? dirty / static_cast<double>(frames) : 0.0,
+            full.percentile(50) / 1000.0,
+            full.percentile(99) / 1000.0,
+            incremental.percentile(50) / 1000.0,
+            incremental.percentile(99) / 1000.0
+        );
+        return EXIT_SUCCESS;
+    }
+
+    // kairos --resume-check [--frames N] [--seed N]
+    // Resumes a network game from its resume files and from frame 0
+    int run_resume_check(const command_line& cmd)
+    {
+        auto frames = cmd.get_uint("--frames", 36000);
+        auto seed = static_cast<unsigned int>(cmd.get_uint("--seed", std::random_device()()));
+
+        auto files = resume_files::of(seed, 0);
+        files.save = std::filesystem::temp_directory_path() / files.save;
+        files.log = std::filesystem::temp_directory_path() / files.log;
+
+        // Written like network_runner does during a game
+        game_world world(seed);
+        random_input_source input(seed);
+        std::vector<std::uint64_t> checksums;
+        state_buffer state;
+        {
+            input_log_writer log(files.log);
+            for(std::uint64_t f = 0; f < frames; ++f)
+            {
+                auto keys = *input.next();
+                log.write(keys);
+                world.apply_input(keys);
+                world.update();
+                checksums.push_back(world.checksum());
+                if((f + 1) % network_runner::save_interval == 0)
+                {
+                    world.save_state(state);
+                    write_save_state(files.save, seed, 0, f + 1, state, checksums);
+                }
+            }
+            log.flush();
+        }
+        world.save_state(state);
+
+        auto load = [&](double& ms) {
+            auto start = std::chrono::steady_clock::now();
+            auto point = load_resume_point(seed, files, frames);
+            ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return point.state == state && point.checksums == checksums;
+        };
+
+        std::uint64_t saved_frame = 0;
+        if(std::filesystem::exists(files.save))
+            saved_frame = mapped_save_state(files.save).frame();
+        double resume_ms = 0, replay_ms = 0;
+        bool resumed = load(resume_ms);
+        std::filesystem::remove(files.save);
+        bool replayed = load(replay_ms);
+        std::filesystem::remove(files.log);
+
+        std::printf(
+            "resume-check: %llu frames, %zu byte state saved at frame %llu\n"
+            "  save state + log: %8.2f ms %s\n"
+            "  log from frame 0: %8.2f ms %s\n",
+            static_cast<unsigned long long>(frames),
+            state.size(),
+            static_cast<unsigned long long>(saved_frame),
+            resume_ms,
+            resumed ? "ok" : "MISMATCH",
+            replay_ms,
+            replayed ? "ok" : "MISMATCH"
+        );
+        return resumed && replayed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // kairos --replay <file> [--seeks N] [--seed N]
+    // Plays a replay as fast as possible, then seeks to random frames
+    // from the keyframes and from frame 0 and checks the states
+    int run_replay(const command_line& cmd)
+    {
+        if(cmd.arg(1).empty())
+            throw std::invalid_argument("usage: kairos --replay <file> [--seeks N] [--seed N]");
+        auto seeks = cmd.get_uint("--seeks", 20);
+        auto seed = cmd.get_uint("--seed", std::random_device()());
+
+        std::filesystem::path path = std::string(cmd.arg(1));
+        auto open_start = std::chrono::steady_clock::now();
+        replay_file file(path);
+        double open_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count();
+        const std::size_t chunks = file.chunk_count();
+        const bool recovered = file.recovered();
+        replay_runner rr(std::move(file));
+        replay_runner slow{ replay_file(path) };
+
+        tick_stats stats;
+        stats.reserve(rr.frames());
+        std::vector<std::uint64_t> checksums;
+        checksums.reserve(rr.frames() + 1);
+        checksums.push_back(rr.game()->checksum());
+        for(;;)
+        {
+            auto start = std::chrono::steady_clock::now();
+            if(!rr.step())
+                break;
+            stats.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            checksums.push_back(rr.game()->checksum());
+        }
+
+        rng pick(seed);
+        tick_stats keyframe_seeks, start_seeks;
+        for(std::uint64_t i = 0; i < seeks; ++i)
+        {
+            // Within the frames the playthrough reached, a damaged chunk ends it early
+            auto target = pick.bounded(static_cast<std::uint32_t>(checksums.size()));
+            // Always from the end, like scrubbing back through a replay
+            rr.go_to(rr.frames());
+            auto start = std::chrono::steady_clock::now();
+            rr.go_to(target);
+            keyframe_seeks.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+            slow.go_to(slow.frames());
+            start = std::chrono::steady_clock::now();
+            slow.go_to(0);
+            while(slow.frame() < target && slow.step()) {}
+            start_seeks.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+            for(auto* r : { &rr, &slow })
+            {
+                if(r->failed())
+                {
+                    std::printf("replay: seek to frame %u failed: %s\n", target, r->error().c_str());
+                    return EXIT_FAILURE;
+                }
+                if(r->game()->checksum() != checksums[target])
+                {
+                    std::printf("replay: seek to frame %u ends in a wrong state\n", target);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        std::printf(
+            "replay: %llu frames, %zu chunks%s, seed %u, %llu entities, opened in %.3f ms\n"
+            "  %.1f ticks/s, final checksum %016llx\n"
+            "  seek from keyframes: p50 %.2f ms, max %.2f ms\n"
+            "  seek from frame 0:   p50 %.2f ms, max %.2f ms\n",
+            static_cast<unsigned long long>(rr.frames()),
+            chunks,
+            recovered ? " (recovered)" : "",
+            rr.file().info().seed,
+            static_cast<unsigned long long>(rr.file().info().entities),
+            open_ms,
+            stats.ticks_per_second(),
+            static_cast<unsigned long long>(checksums.back()),
+            keyframe_seeks.percentile(50) / 1e6,
+            keyframe_seeks.percentile(100) / 1e6,
+            start_seeks.percentile(50) / 1e6,
+            start_seeks.percentile(100) / 1e6
+        );
+        detailed::print_input_codecs(rr.file());
+        return EXIT_SUCCESS;
+    }
+
+    // kairos --replay-bench <directory or file>
+    int run_replay_bench(const command_line& cmd)
+    {
+        if(cmd.arg(1).empty())
+            throw std::invalid_argument("usage: kairos --replay-bench <directory or file>");
+        std::filesystem::path corpus = std::string(cmd.arg(1));
+
+        std::vector<std::filesystem::path> paths;
+        if(std::filesystem::is_directory(corpus))
+        {
+            for(auto& entry : std::filesystem::directory_iterator(corpus))
+            {
+                if(entry.is_regular_file() && entry.path().extension() == ".awr")
+                    paths.push_back(entry.path());
+            }
+            std::sort(paths.begin(), paths.end());
+        }
+        else
+            paths.push_back(corpus);
+
+        // One JSON object per line, then a summary
+        std::size_t passed = 0, failed = 0;
+        std::uint64_t total_ticks = 0, total_ns = 0;
+        for(auto& path : paths)
+        {
+            std::string name = detailed::json_string(path.filename().string());
+            try
+            {
+                replay_runner rr{ replay_file(path) };
+                tick_stats stats;
+                stats.reserve(rr.frames());
+                for(;;)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    if(!rr.step())
+                        break;
+                    stats.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                }
+
+                const std::uint64_t checksum = rr.game()->checksum();
+                const auto expected = rr.file().checksum();
+                // Only a closed recording has its checksum, a recovered
+                // file lost the end of the game and can't be checked
+                const char* status = "truncated";
+                if(stats.count() == rr.frames() && !rr.file().recovered() && expected)
+                    status = *expected == checksum ? "ok" : "mismatch";
+                if(std::string_view(status) == "ok")
+                    ++passed;
+                else
+                    ++failed;
+                total_ticks += stats.count();
+                total_ns += stats.total();
+
+                char expected_str[24] = "null";
+                if(expected)
+                    std::snprintf(expected_str, sizeof(expected_str), "\"%016llx\"", static_cast<unsigned long long>(*expected));
+                auto us = [&stats](double p) { return stats.percentile(p) / 1000.0; };
+                std::printf(
+                    "{\"replay\":%s,\"status\":\"%s\",\"frames\":%llu,\"entities\":%llu,"
+                    "\"ticks_per_s\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f,"
+                    "\"checksum\":\"%016llx\",\"expected\":%s}\n",
+                    name.c_str(),
+                    status,
+                    static_cast<unsigned long long>(rr.frames()),
+                    static_cast<unsigned long long>(rr.file().info().entities),
+                    stats.ticks_per_second(),
+                    us(50), us(90), us(99), us(99.9), us(100),
+                    static_cast<unsigned long long>(checksum),
+                    expected_str
+                );
+            }
+            catch(const std::exception& e)
+            {
+                ++failed;
+                std::printf(
+                    "{\"replay\":%s,\"status\":\"error\",\"error\":%s}\n",
+                    name.c_str(),
+                    detailed::json_string(e.what()).c_str()
+                );
+            }
+            std::fflush(stdout);
+        }
+
+        std::printf(
+            "{\"summary\":true,\"replays\":%zu,\"ok\":%zu,\"failed\":%zu,\"ticks_per_s\":%.1f}\n",
+            paths.size(),
+            passed,
+            failed,
+            total_ns == 0 ? 0.0 : total_ticks * 1e9 / static_cast<double>(total_ns)
+        );
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // kairos --replay-export <file> <directory> [--size N] [--from N] [--to N] [--every N] [--threads N] [--sprites DIR]
+    int run_replay_export(const command_line& cmd)
+    {
+        if(cmd.arg(1).empty() || cmd.arg(2).empty())
+            throw std::invalid_argument("usage: kairos --replay-export <file> <directory> [--size N] [--from N] [--to N] [--every N] [--threads N] [--sprites DIR]");
+        export_options opts;
+        opts.directory = std::string(cmd.arg(2));
+        opts.size = static_cast<int>(cmd.get_uint("--size", opts.size));
+        opts.first = cmd.get_uint("--from", opts.first);
+        opts.last = cmd.get_uint("--to", opts.last);
+        opts.every = cmd.get_uint("--every", opts.every);
+        opts.threads = static_cast<unsigned int>(cmd.get_uint("--threads", opts.threads));
+        if(auto dir = cmd.get("--sprites"))
+            opts.sprites = std::string(*dir);
+        else
+            opts.sprites = sprite_directory();
+
+        auto stats = export_replay(replay_file(std::string(cmd.arg(1))), opts);
+        std::printf(
+            "replay-export: %llu images of %dx%d to %s\n"
+            "  %.2f s, %.1f images/s on %u threads, %.2f s simulating and rendering\n",
+            static_cast<unsigned long long>(stats.images),
+            opts.size,
+            opts.size,
+            opts.directory.string().c_str(),
+            stats.seconds,
+            stats.seconds > 0 ? stats.images / stats.seconds : 0.0,
+            stats.threads,
+            stats.render_seconds
+        );
+        return EXIT_SUCCESS;
+    }
+
+    // kairos --replay-list [directory]
+    int run_replay_list(const command_line& cmd)
+    {
+        std::filesystem::path dir = cmd.arg(1).empty() ? replay_directory() : std::filesystem::path(std::string(cmd.arg(1)));
+
+        replay_library lib;
+        auto start = std::chrono::steady_clock::now();
+        lib.refresh(dir);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for(auto& e : lib.entries())
+        {
+            char checksum[24] = "-";
+            if(e.meta.checksum)
+                std::snprintf(checksum, sizeof(checksum), "%016llx", static_cast<unsigned long long>(*e.meta.checksum));
+            std::printf(
+                "%s  %8llu frames%s  %uP  seed %-10u  %s  %s\n",
+                format_replay_date(e.meta.date).c_str(),
+                static_cast<unsigned long long>(e.meta.frames),
+                e.meta.complete ? "" : " (unfinished)",
+                e.meta.info.players,
+                e.meta.info.seed,
+                checksum,
+                e.path.filename().string().c_str()
+            );
+        }
+        std::printf(
+            "replay-list: %zu replays in %s, %zu headers read, %.2f ms\n",
+            lib.entries().size(),
+            dir.string().c_str(),
+            lib.headers_read(),
+            ms
+        );
+        return EXIT_SUCCESS;
+    }
+
+    // kairos --atlas [directory]
+    int run_atlas(const command_line& cmd)
+    {
+        std::filesystem::path dir = cmd.arg(1).empty() ? sprite_directory() : std::filesystem::path(std::string(cmd.arg(1)));
+        const auto cache_dir = atlas_cache_directory(dir);
+
+        using clock = std::chrono::steady_clock;
+        auto ms_since = [](clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        };
+
+        auto start = clock::now();
+        auto packed = load_atlas_image(dir, {});
+        double pack_ms = ms_since(start);
+        if(packed.sprites.empty())
+        {
+            std::printf("atlas: no sprites in %s\n", dir.string().c_str());
+            return EXIT_SUCCESS;
+        }
+
+        // Writes the cache if it is missing or stale, then reads it
+        start = clock::now();
+        auto first = load_atlas_image(dir, cache_dir);
+        double first_ms = ms_since(start);
+        start = clock::now();
+        auto cached = load_atlas_image(dir, cache_dir);
+        double cached_ms = ms_since(start);
+
+        std::uint64_t used = 0;
+        for(auto& [name, rect] : packed.sprites)
+            used += static_cast<std::uint64_t>(rect.w) * rect.h;
+        std::printf(
+            "atlas: %zu sprites in a %dx%d atlas, %.1f%% used\n"
+            "  decode and pack %8.2f ms\n"
+            "  first load      %8.2f ms (%s)\n"
+            "  cached load     %8.2f ms (%s)\n",
+            packed.sprites.size(),
+            packed.width,
+            packed.height,
+            100.0 * used / (static_cast<double>(packed.width) * packed.height),
+            pack_ms,
+            first_ms,
+            first.from_cache ? "cache" : "packed, cache written",
+            cached_ms,
+            cached.from_cache ? "cache" : "packed, the cache can't be written"
+        );
+
+        auto same_rects = [](const SDL_Rect& lhs, const SDL_Rect& rhs) {
+            return lhs.x == rhs.x && lhs.y == rhs.y && lhs.w == rhs.w && lhs.h == rhs.h;
+        };
+        bool same = cached.width == packed.width &&
+            cached.height == packed.height &&
+            cached.pixels == packed.pixels &&
+            std::equal(
+                cached.sprites.begin(), cached.sprites.end(),
+                packed.sprites.begin(), packed.sprites.end(),
+                [&](auto& lhs, auto& rhs) { return lhs.first == rhs.first && same_rects(lhs.second, rhs.second); }
+            );
+        if(!same)
+        {
+            std::printf("atlas: the cached atlas differs from the packed one\n");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+
+namespace awe
+{
+    // Minimal "--name value" argument parser for the headless tools
+    class command_line
+    {
+    public:
+        command_line(int argc, char* argv[]);
+
+        bool has(std::string_view opt) const;
+        // Value following the option
+        std::optional<std::string_view> get(std::string_view opt) const;
+        // Throws std::invalid_argument if the value is not a number
+        std::uint64_t get_uint(std::string_view opt, std::uint64_t def) const;
+
+        std::string_view command() const noexcept
+        {
+            return arg(0);
+        }
+        std::string_view arg(std::size_t i) const noexcept
+        {
+            return i < m_args.size() ? m_args[i] : std::string_view();
+        }
+
+    private:
+        std::vector<std::string_view> m_args;
+    };
+
+    // Runs a headless tool if the first argument names one,
+    // returns the exit code of the tool or std::nullopt otherwise
+    std::optional<int> run_tool(int argc, char* argv[]);
+
+    int run_synctest(const command_line& cmd);
+    int run_desync_diff(const command_line& cmd);
+    int run_headless(const command_line& cmd);
+    int run_fuzz(const command_line& cmd);
+    int run_parallel_check(const command_line& cmd);
+    int run_parallel_bench(const command_line& cmd);
+    int run_checksum_bench(const command_line& cmd);
+    int run_resume_check(const command_line& cmd);
+    int run_replay(const command_line& cmd);
+    int run_replay_bench(const command_line& cmd);
+    int run_replay_export(const command_line& cmd);
+    int run_replay_list(const command_line& cmd);
+    int run_atlas(const command_line& cmd);
+}
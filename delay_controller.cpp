@@ -0,0 +1,83 @@
+#include "delay_controller.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+namespace awe
+{
+    delay_controller::delay_controller(unsigned int tick_rate, unsigned int initial_delay)
+        : m_tick_ms(1000.0 / tick_rate)
+    {
+        m_status.delay = initial_delay;
+        m_status.target = initial_delay;
+    }
+
+    void delay_controller::add_rtt(double ms)
+    {
+        std::lock_guard guard(m_mutex);
+        auto& s = m_status;
+        if(!s.measured)
+        {
+            s.rtt_ms = ms;
+            s.jitter_ms = ms / 2.0;
+            s.measured = true;
+            return;
+        }
+        // Smoothed like the retransmission timer of TCP (RFC 6298)
+        s.jitter_ms += (std::abs(ms - s.rtt_ms) - s.jitter_ms) / 4.0;
+        s.rtt_ms += (ms - s.rtt_ms) / 8.0;
+    }
+
+    unsigned int delay_controller::update(std::uint64_t remote_inputs, std::uint64_t mispredicted_inputs)
+    {
+        std::lock_guard guard(m_mutex);
+        auto& s = m_status;
+
+        // Moving average over about the last 64 remote inputs. A batch moves
+        // it as far as that many inputs one by one at the batch's rate would.
+        std::uint64_t inputs = remote_inputs - m_remote_inputs;
+        std::uint64_t mispredicted = mispredicted_inputs - m_mispredicted_inputs;
+        m_remote_inputs = remote_inputs;
+        m_mispredicted_inputs = mispredicted_inputs;
+        if(inputs > 0)
+        {
+            double weight = 1.0 - std::pow(1.0 - 1.0 / 64.0, static_cast<double>(inputs));
+            double rate = static_cast<double>(mispredicted) / static_cast<double>(inputs);
+            s.misprediction_rate += (rate - s.misprediction_rate) * weight;
+        }
+
+        if(!s.measured)
+            return s.delay;
+
+        // A quarter frame of hysteresis keeps a latency near a frame
+        // boundary from flipping the delay back and forth
+        double ideal = ideal_delay();
+        if(ideal > s.delay + 0.25 || ideal <= s.delay - 1.25)
+            s.target = std::min(static_cast<unsigned int>(std::ceil(ideal)), max_delay);
+        else
+            s.target = s.delay;
+
+        if(++m_ticks_since_step >= step_interval && s.target != s.delay)
+        {
+            s.delay += s.target > s.delay ? 1 : -1;
+            m_ticks_since_step = 0;
+        }
+        return s.delay;
+    }
+
+    delay_controller::status delay_controller::get_status() const
+    {
+        std::lock_guard guard(m_mutex);
+        return m_status;
+    }
+
+    double delay_controller::ideal_delay() const noexcept
+    {
+        const auto& s = m_status;
+        double one_way = (s.rtt_ms / 2.0 + 2.0 * s.jitter_ms) / m_tick_ms;
+        double frames = one_way - rollback_frames;
+        if(s.misprediction_rate > high_misprediction_rate)
+            frames += 1.0;
+        return std::max(frames, 0.0);
+    }
+}
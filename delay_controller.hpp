@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+
+namespace awe
+{
+    //  Picks the input delay from the measured round-trip time.
+    //  A frame of delay hides a frame of latency but makes the game feel
+    //  slower, a frame of latency it leaves to prediction may cost a rollback.
+    //  The delay covers the one-way latency minus rollback_frames, plus one
+    //  more frame while the remote inputs are hard to predict.
+    class delay_controller
+    {
+    public:
+        static constexpr unsigned int max_delay = 8;
+        // Frames of latency left to prediction and rollback
+        static constexpr double rollback_frames = 2.0;
+        // Misprediction rate above which a frame of delay is added
+        static constexpr double high_misprediction_rate = 0.25;
+        // Ticks between two steps of the delay, which moves by one frame at a time
+        static constexpr std::uint64_t step_interval = 60;
+
+        struct status
+        {
+            unsigned int delay = 0;
+            unsigned int target = 0;
+            double rtt_ms = 0.0;
+            double jitter_ms = 0.0;
+            // Fraction of the recent remote inputs that were mispredicted
+            double misprediction_rate = 0.0;
+            bool measured = false;
+        };
+
+        delay_controller(unsigned int tick_rate, unsigned int initial_delay);
+
+        // Called from the network thread
+        void add_rtt(double ms);
+
+        // Called once per tick with the totals of the session.
+        // Returns the delay to use from now on.
+        unsigned int update(std::uint64_t remote_inputs, std::uint64_t mispredicted_inputs);
+
+        status get_status() const;
+
+    private:
+        double m_tick_ms;
+
+        mutable std::mutex m_mutex;
+        status m_status;
+        std::uint64_t m_ticks_since_step = 0;
+        std::uint64_t m_remote_inputs = 0;
+        std::uint64_t m_mispredicted_inputs = 0;
+
+        // Delay in frames, before rounding
+        double ideal_delay() const noexcept;
+    };
+}
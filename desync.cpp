@@ -0,0 +1,247 @@
+#include "desync.hpp"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        constexpr char dump_magic[8] = { 'A', 'W', 'E', 'D', 'S', 'Y', 'N', 'C' };
+        constexpr std::uint32_t dump_version = 2; // 2: Merkle tree checksums
+
+        typedef std::map<std::string, std::array<std::optional<std::int64_t>, 3>> field_table;
+
+        void collect_fields(field_table& table, std::vector<std::string>& order, const game_world& w, std::size_t column)
+        {
+            w.visit_fields([&](std::string_view name, std::int64_t value) {
+                auto [it, inserted] = table.try_emplace(std::string(name));
+                if(inserted)
+                    order.push_back(it->first);
+                it->second[column] = value;
+            });
+        }
+
+        const desync_dump::snapshot* find_snapshot(const desync_dump& d, std::uint64_t frame)
+        {
+            for(auto& s : d.snapshots)
+            {
+                if(s.frame == frame)
+                    return &s;
+            }
+            return nullptr;
+        }
+    }
+
+    void desync_dump::save(const std::filesystem::path& path) const
+    {
+        state_buffer buf;
+        state_writer w(buf);
+        w.write_bytes(detailed::dump_magic, sizeof(detailed::dump_magic));
+        w.write<std::uint32_t>(detailed::dump_version);
+        w.write<std::uint32_t>(seed);
+        w.write<std::int32_t>(local_player);
+        w.write<std::uint64_t>(desync_frame);
+
+        w.write<std::uint64_t>(inputs.size());
+        for(auto& i : inputs)
+            w.write_bytes(i.keys.data(), i.keys.size());
+        w.write<std::uint64_t>(checksums.size());
+        for(auto c : checksums)
+            w.write<std::uint64_t>(c);
+        w.write<std::uint64_t>(snapshots.size());
+        for(auto& s : snapshots)
+        {
+            w.write<std::uint64_t>(s.frame);
+            w.write<std::uint64_t>(s.state.size());
+            w.write_bytes(s.state.data(), s.state.size());
+        }
+
+        std::ofstream ofs(path, std::ios::binary);
+        ofs.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+        if(!ofs)
+            throw std::runtime_error("failed to write " + path.string());
+    }
+
+    desync_dump desync_dump::load(const std::filesystem::path& path)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        if(!ifs)
+            throw std::runtime_error("failed to open " + path.string());
+        state_buffer buf(std::filesystem::file_size(path));
+        ifs.read(reinterpret_cast<char*>(buf.data()), buf.size());
+        if(static_cast<std::size_t>(ifs.gcount()) != buf.size())
+            throw std::runtime_error("failed to read " + path.string());
+
+        state_reader r(buf);
+        char magic[sizeof(detailed::dump_magic)];
+        r.read_bytes(magic, sizeof(magic));
+        if(!std::equal(std::begin(magic), std::end(magic), detailed::dump_magic))
+            throw std::runtime_error(path.string() + " is not a desync dump");
+        if(r.read<std::uint32_t>() != detailed::dump_version)
+            throw std::runtime_error(path.string() + " has an unsupported version");
+
+        desync_dump d;
+        d.seed = r.read<std::uint32_t>();
+        d.local_player = r.read<std::int32_t>();
+        d.desync_frame = r.read<std::uint64_t>();
+
+        // Counts are checked against the rest of the file before allocating
+        d.inputs.resize(r.check_count(r.read<std::uint64_t>(), max_players));
+        for(auto& i : d.inputs)
+            r.read_bytes(i.keys.data(), i.keys.size());
+        d.checksums.resize(r.check_count(r.read<std::uint64_t>(), sizeof(std::uint64_t)));
+        for(auto& c : d.checksums)
+            c = r.read<std::uint64_t>();
+        // A frame and a size at least
+        d.snapshots.resize(r.check_count(r.read<std::uint64_t>(), 2 * sizeof(std::uint64_t)));
+        for(auto& s : d.snapshots)
+        {
+            s.frame = r.read<std::uint64_t>();
+            s.state.resize(r.check_count(r.read<std::uint64_t>(), 1));
+            r.read_bytes(s.state.data(), s.state.size());
+        }
+
+        return d;
+    }
+
+    std::optional<std::uint64_t> diff_dumps(
+        const desync_dump& a,
+        const desync_dump& b,
+        std::FILE* out
+    ) {
+        if(a.seed != b.seed)
+        {
+            std::fprintf(out, "Seeds differ: %u vs %u\n", a.seed, b.seed);
+            return 0;
+        }
+
+        // Only the inputs both peers agree on can be replayed
+        std::uint64_t inputs = std::min(a.inputs.size(), b.inputs.size());
+        for(std::uint64_t f = 0; f < inputs; ++f)
+        {
+            if(a.inputs[f] != b.inputs[f])
+            {
+                std::fprintf(out, "Confirmed inputs differ at frame %llu\n", static_cast<unsigned long long>(f));
+                inputs = f;
+                break;
+            }
+        }
+
+        std::optional<std::uint64_t> first_a, first_b, first_peer;
+        game_world ref(a.seed);
+        for(std::uint64_t f = 0; f < inputs; ++f)
+        {
+            ref.apply_input(a.inputs[f]);
+            ref.update();
+            std::uint64_t checksum = ref.checksum();
+            if(!first_a && f < a.checksums.size() && a.checksums[f] != checksum)
+                first_a = f;
+            if(!first_b && f < b.checksums.size() && b.checksums[f] != checksum)
+                first_b = f;
+            if(!first_peer && f < a.checksums.size() && f < b.checksums.size() && a.checksums[f] != b.checksums[f])
+                first_peer = f;
+            if(first_a && first_b && first_peer)
+                break;
+        }
+
+        auto print_frame = [out](const char* what, const std::optional<std::uint64_t>& frame) {
+            if(frame)
+                std::fprintf(out, "%s: frame %llu\n", what, static_cast<unsigned long long>(*frame));
+            else
+                std::fprintf(out, "%s: none\n", what);
+        };
+        std::fprintf(out, "Replayed %llu frames from seed %u\n", static_cast<unsigned long long>(inputs), a.seed);
+        print_frame("A diverges from replay", first_a);
+        print_frame("B diverges from replay", first_b);
+        print_frame("A diverges from B", first_peer);
+
+        std::optional<std::uint64_t> first;
+        for(auto& f : { first_a, first_b, first_peer })
+        {
+            if(f && (!first || *f < *first))
+                first = f;
+        }
+        if(!first)
+            return std::nullopt;
+
+        // Earliest kept state after the divergent frame
+        std::optional<std::uint64_t> target;
+        for(auto* d : { &a, &b })
+        {
+            for(auto& s : d->snapshots)
+            {
+                if(s.frame > *first && (!target || s.frame < *target))
+                    target = s.frame;
+            }
+        }
+        if(!target)
+        {
+            std::fprintf(out, "No state kept after frame %llu\n", static_cast<unsigned long long>(*first));
+            return first;
+        }
+
+        detailed::field_table table;
+        std::vector<std::string> order;
+        if(*target <= inputs)
+        {
+            game_world w(a.seed);
+            for(std::uint64_t f = 0; f < *target; ++f)
+            {
+                w.apply_input(a.inputs[f]);
+                w.update();
+            }
+            detailed::collect_fields(table, order, w, 0);
+        }
+        std::size_t column = 1;
+        for(auto* d : { &a, &b })
+        {
+            if(auto* s = detailed::find_snapshot(*d, *target))
+            {
+                game_world w(d->seed);
+                w.load_state(s->state);
+                detailed::collect_fields(table, order, w, column);
+            }
+            ++column;
+        }
+
+        std::fprintf(
+            out,
+            "Fields differing before frame %llu:\n%-24s %20s %20s %20s\n",
+            static_cast<unsigned long long>(*target),
+            "field", "replay", "A", "B"
+        );
+        auto print_value = [out](const std::optional<std::int64_t>& v) {
+            if(v)
+                std::fprintf(out, " %20lld", static_cast<long long>(*v));
+            else
+                std::fprintf(out, " %20s", "-");
+        };
+        for(auto& name : order)
+        {
+            auto& values = table[name];
+            std::optional<std::int64_t> seen;
+            bool differs = false;
+            for(auto& v : values)
+            {
+                if(!v)
+                    continue;
+                if(seen && *seen != *v)
+                    differs = true;
+                seen = v;
+            }
+            if(!differs)
+                continue;
+            std::fprintf(out, "%-24s", name.c_str());
+            for(auto& v : values)
+                print_value(v);
+            std::fprintf(out, "\n");
+        }
+
+        return first;
+    }
+}
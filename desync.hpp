@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+#include <vector>
+#include "game.hpp"
+
+
+namespace awe
+{
+    //  Forensic data written by each peer when the checksums disagree
+    struct desync_dump
+    {
+        struct snapshot
+        {
+            std::uint64_t frame; // state before this frame
+            state_buffer state;
+        };
+
+        unsigned int seed = 0;
+        int local_player = -1;
+        std::uint64_t desync_frame = 0;
+        // Confirmed inputs since frame 0
+        std::vector<frame_input> inputs;
+        // Checksum of the state after each confirmed frame
+        std::vector<std::uint64_t> checksums;
+        // Recent confirmed states, ordered by frame
+        std::vector<snapshot> snapshots;
+
+        // Throws std::runtime_error on failure
+        void save(const std::filesystem::path& path) const;
+        static desync_dump load(const std::filesystem::path& path);
+    };
+
+    //  Replays the inputs from the seed to find the first frame where the
+    //  peers diverge and prints a field by field diff of the states around it.
+    //  Returns the first divergent frame, if any.
+    std::optional<std::uint64_t> diff_dumps(
+        const desync_dump& a,
+        const desync_dump& b,
+        std::FILE* out
+    );
+}
@@ -0,0 +1,167 @@
+#include "entity.hpp"
+
+
+namespace awe
+{
+    entity_handle entity_storage::create(q16_16 x, q16_16 y, q16_16 vx, q16_16 vy, std::int8_t owner, std::uint8_t flags)
+    {
+        std::uint32_t slot;
+        if(!m_free_slots.empty())
+        {
+            slot = m_free_slots.back();
+            m_free_slots.pop_back();
+        }
+        else
+        {
+            slot = static_cast<std::uint32_t>(m_dense.size());
+            m_dense.push_back(0);
+            m_generations.push_back(0);
+        }
+
+        m_dense[slot] = static_cast<std::uint32_t>(size());
+        m_pos_x.push_back(x);
+        m_pos_y.push_back(y);
+        m_vel_x.push_back(vx);
+        m_vel_y.push_back(vy);
+        m_owner.push_back(owner);
+        m_flags.push_back(flags);
+        m_slots.push_back(slot);
+
+        return { slot, m_generations[slot] };
+    }
+
+    bool entity_storage::destroy(entity_handle h)
+    {
+        auto idx = index_of(h);
+        if(!idx)
+            return false;
+
+        std::size_t last = size() - 1;
+        if(*idx != last)
+        {
+            m_pos_x[*idx] = m_pos_x[last];
+            m_pos_y[*idx] = m_pos_y[last];
+            m_vel_x[*idx] = m_vel_x[last];
+            m_vel_y[*idx] = m_vel_y[last];
+            m_owner[*idx] = m_owner[last];
+            m_flags[*idx] = m_flags[last];
+            m_slots[*idx] = m_slots[last];
+            m_dense[m_slots[*idx]] = static_cast<std::uint32_t>(*idx);
+        }
+        m_pos_x.pop_back();
+        m_pos_y.pop_back();
+        m_vel_x.pop_back();
+        m_vel_y.pop_back();
+        m_owner.pop_back();
+        m_flags.pop_back();
+        m_slots.pop_back();
+
+        ++m_generations[h.slot];
+        m_free_slots.push_back(h.slot);
+
+        return true;
+    }
+
+    void entity_storage::clear()
+    {
+        *this = entity_storage();
+    }
+
+    void entity_storage::reserve(std::size_t n)
+    {
+        m_pos_x.reserve(n);
+        m_pos_y.reserve(n);
+        m_vel_x.reserve(n);
+        m_vel_y.reserve(n);
+        m_owner.reserve(n);
+        m_flags.reserve(n);
+        m_slots.reserve(n);
+    }
+
+    bool entity_storage::alive(entity_handle h) const noexcept
+    {
+        return index_of(h).has_value();
+    }
+
+    std::optional<std::size_t> entity_storage::index_of(entity_handle h) const noexcept
+    {
+        if(h.slot >= m_generations.size() || m_generations[h.slot] != h.generation)
+            return std::nullopt;
+        std::uint32_t idx = m_dense[h.slot];
+        if(idx >= size() || m_slots[idx] != h.slot)
+            return std::nullopt;
+        return idx;
+    }
+
+    void entity_storage::save_state(state_writer& w) const
+    {
+        w.write<std::uint32_t>(static_cast<std::uint32_t>(size()));
+        w.write_array(m_pos_x.data(), size());
+        w.write_array(m_pos_y.data(), size());
+        w.write_array(m_vel_x.data(), size());
+        w.write_array(m_vel_y.data(), size());
+        w.write_array(m_owner.data(), size());
+        w.write_array(m_flags.data(), size());
+        w.write_array(m_slots.data(), size());
+
+        w.write<std::uint32_t>(static_cast<std::uint32_t>(m_generations.size()));
+        w.write_array(m_generations.data(), m_generations.size());
+        w.write<std::uint32_t>(static_cast<std::uint32_t>(m_free_slots.size()));
+        w.write_array(m_free_slots.data(), m_free_slots.size());
+    }
+    void entity_storage::state_pieces(std::array<std::uint32_t, 3>& counts, std::vector<std::span<const std::byte>>& out) const
+    {
+        counts = {
+            static_cast<std::uint32_t>(size()),
+            static_cast<std::uint32_t>(m_generations.size()),
+            static_cast<std::uint32_t>(m_free_slots.size())
+        };
+        auto count = [&](std::size_t i) { return std::as_bytes(std::span(counts).subspan(i, 1)); };
+        out.push_back(count(0));
+        out.push_back(std::as_bytes(std::span(m_pos_x)));
+        out.push_back(std::as_bytes(std::span(m_pos_y)));
+        out.push_back(std::as_bytes(std::span(m_vel_x)));
+        out.push_back(std::as_bytes(std::span(m_vel_y)));
+        out.push_back(std::as_bytes(std::span(m_owner)));
+        out.push_back(std::as_bytes(std::span(m_flags)));
+        out.push_back(std::as_bytes(std::span(m_slots)));
+        out.push_back(count(1));
+        out.push_back(std::as_bytes(std::span(m_generations)));
+        out.push_back(count(2));
+        out.push_back(std::as_bytes(std::span(m_free_slots)));
+    }
+    void entity_storage::load_state(state_reader& r)
+    {
+        constexpr std::size_t entity_bytes =
+            4 * sizeof(q16_16) + sizeof(std::int8_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t);
+        std::size_t n = r.check_count(r.read<std::uint32_t>(), entity_bytes);
+        m_pos_x.resize(n);
+        m_pos_y.resize(n);
+        m_vel_x.resize(n);
+        m_vel_y.resize(n);
+        m_owner.resize(n);
+        m_flags.resize(n);
+        m_slots.resize(n);
+        r.read_array(m_pos_x.data(), n);
+        r.read_array(m_pos_y.data(), n);
+        r.read_array(m_vel_x.data(), n);
+        r.read_array(m_vel_y.data(), n);
+        r.read_array(m_owner.data(), n);
+        r.read_array(m_flags.data(), n);
+        r.read_array(m_slots.data(), n);
+
+        m_generations.resize(r.check_count(r.read<std::uint32_t>(), sizeof(std::uint32_t)));
+        r.read_array(m_generations.data(), m_generations.size());
+        m_free_slots.resize(r.check_count(r.read<std::uint32_t>(), sizeof(std::uint32_t)));
+        r.read_array(m_free_slots.data(), m_free_slots.size());
+
+        // The slot to dense table is derived
+        m_dense.assign(m_generations.size(), 0);
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            if(m_slots[i] >= m_dense.size())
+                throw std::out_of_range("invalid entity slot");
+            m_dense[m_slots[i]] = static_cast<std::uint32_t>(i);
+        }
+    }
+}
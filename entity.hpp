@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "fixed.hpp"
+#include "state.hpp"
+
+
+namespace awe
+{
+    // Stays valid until the entity is destroyed, even when others are removed
+    struct entity_handle
+    {
+        std::uint32_t slot = 0;
+        std::uint32_t generation = 0;
+
+        friend bool operator==(const entity_handle&, const entity_handle&) = default;
+    };
+
+    //  Entities stored as structure of arrays.
+    //  Components are densely packed and indexed by the dense index, removal
+    //  swaps the last entity into the hole. Handles go through a slot table
+    //  with generation counters, so they stay stable.
+    class entity_storage
+    {
+    public:
+        enum flag : std::uint8_t
+        {
+            FLAG_NONE = 0,
+            FLAG_SOLID = 1 << 0
+        };
+
+        // The fixed-point components, in the order save_state writes them
+        enum component : std::uint8_t
+        {
+            COMP_POS_X,
+            COMP_POS_Y,
+            COMP_VEL_X,
+            COMP_VEL_Y
+        };
+
+        // No owner player
+        static constexpr std::int8_t no_owner = -1;
+
+        entity_handle create(q16_16 x, q16_16 y, q16_16 vx, q16_16 vy, std::int8_t owner, std::uint8_t flags);
+        bool destroy(entity_handle h);
+        void clear();
+        void reserve(std::size_t n);
+
+        bool alive(entity_handle h) const noexcept;
+        std::optional<std::size_t> index_of(entity_handle h) const noexcept;
+        entity_handle handle_at(std::size_t index) const noexcept
+        {
+            std::uint32_t slot = m_slots[index];
+            return { slot, m_generations[slot] };
+        }
+
+        // Dense index of a live slot
+        std::size_t index_of_slot(std::uint32_t slot) const noexcept { return m_dense[slot]; }
+
+        std::size_t size() const noexcept { return m_slots.size(); }
+        bool empty() const noexcept { return m_slots.empty(); }
+
+        // Component arrays, indexed by the dense index
+        std::span<q16_16> pos_x() noexcept { return m_pos_x; }
+        std::span<q16_16> pos_y() noexcept { return m_pos_y; }
+        std::span<q16_16> vel_x() noexcept { return m_vel_x; }
+        std::span<q16_16> vel_y() noexcept { return m_vel_y; }
+        std::span<std::int8_t> owner() noexcept { return m_owner; }
+        std::span<std::uint8_t> flags() noexcept { return m_flags; }
+        std::span<const q16_16> pos_x() const noexcept { return m_pos_x; }
+        std::span<const q16_16> pos_y() const noexcept { return m_pos_y; }
+        std::span<const q16_16> vel_x() const noexcept { return m_vel_x; }
+        std::span<const q16_16> vel_y() const noexcept { return m_vel_y; }
+        std::span<const std::int8_t> owner() const noexcept { return m_owner; }
+        std::span<const std::uint8_t> flags() const noexcept { return m_flags; }
+        std::span<const std::uint32_t> slots() const noexcept { return m_slots; }
+
+        // Every component array is written as one contiguous block
+        void save_state(state_writer& w) const;
+        void load_state(state_reader& r);
+        // The bytes save_state writes, as pieces pointing into the storage and
+        // into counts, which receives the counts written between the arrays.
+        // Little-endian hosts only, valid until the storage changes.
+        void state_pieces(std::array<std::uint32_t, 3>& counts, std::vector<std::span<const std::byte>>& out) const;
+        // Where the block of a component starts in the saved state
+        std::size_t state_offset(component c) const noexcept
+        {
+            return sizeof(std::uint32_t) + c * size() * sizeof(q16_16);
+        }
+
+        template <typename F>
+        void visit_fields(F&& f) const
+        {
+            for(std::size_t i = 0; i < size(); ++i)
+            {
+                std::string prefix = "entity[" + std::to_string(m_slots[i]) + "].";
+                f(prefix + "x", static_cast<std::int64_t>(m_pos_x[i].raw()));
+                f(prefix + "y", static_cast<std::int64_t>(m_pos_y[i].raw()));
+                f(prefix + "vx", static_cast<std::int64_t>(m_vel_x[i].raw()));
+                f(prefix + "vy", static_cast<std::int64_t>(m_vel_y[i].raw()));
+                f(prefix + "owner", static_cast<std::int64_t>(m_owner[i]));
+                f(prefix + "flags", static_cast<std::int64_t>(m_flags[i]));
+            }
+        }
+
+    private:
+        // Dense components
+        std::vector<q16_16> m_pos_x;
+        std::vector<q16_16> m_pos_y;
+        std::vector<q16_16> m_vel_x;
+        std::vector<q16_16> m_vel_y;
+        std::vector<std::int8_t> m_owner;
+        std::vector<std::uint8_t> m_flags;
+        std::vector<std::uint32_t> m_slots; // dense index to slot
+
+        // Slot table
+        std::vector<std::uint32_t> m_dense; // slot to dense index
+        std::vector<std::uint32_t> m_generations;
+        std::vector<std::uint32_t> m_free_slots;
+    };
+}
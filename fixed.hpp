@@ -0,0 +1,374 @@
+#pragma once
+
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        // Portable 128-bit unsigned integer for the Q32.32 products,
+        // so MSVC gives the same results as compilers with __int128
+        struct u128
+        {
+            std::uint64_t hi = 0;
+            std::uint64_t lo = 0;
+
+            friend constexpr bool operator==(const u128&, const u128&) = default;
+            friend constexpr auto operator<=>(const u128& l, const u128& r) noexcept
+            {
+                if(l.hi != r.hi)
+                    return l.hi <=> r.hi;
+                return l.lo <=> r.lo;
+            }
+        };
+
+        constexpr u128 mul_u64(std::uint64_t a, std::uint64_t b) noexcept
+        {
+            std::uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+            std::uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+
+            std::uint64_t ll = a_lo * b_lo;
+            std::uint64_t lh = a_lo * b_hi;
+            std::uint64_t hl = a_hi * b_lo;
+            std::uint64_t hh = a_hi * b_hi;
+
+            std::uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFFu) + (hl & 0xFFFFFFFFu);
+            u128 r;
+            r.lo = (mid << 32) | (ll & 0xFFFFFFFFu);
+            r.hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+            return r;
+        }
+
+        constexpr u128 shl(u128 v, unsigned int n) noexcept
+        {
+            if(n == 0)
+                return v;
+            if(n >= 64)
+                return { v.lo << (n - 64), 0 };
+            return { (v.hi << n) | (v.lo >> (64 - n)), v.lo << n };
+        }
+        constexpr u128 shr(u128 v, unsigned int n) noexcept
+        {
+            if(n == 0)
+                return v;
+            if(n >= 64)
+                return { 0, v.hi >> (n - 64) };
+            return { v.hi >> n, (v.lo >> n) | (v.hi << (64 - n)) };
+        }
+        constexpr u128 sub(u128 l, u128 r) noexcept
+        {
+            u128 d;
+            d.lo = l.lo - r.lo;
+            d.hi = l.hi - r.hi - (l.lo < r.lo ? 1 : 0);
+            return d;
+        }
+        constexpr u128 neg(u128 v) noexcept
+        {
+            return sub({ 0, 0 }, v);
+        }
+
+        // Truncating 128 by 64 bit division, returns the low 64 bits of the quotient
+        constexpr std::uint64_t div_u128(u128 n, std::uint64_t d) noexcept
+        {
+            u128 rem;
+            u128 q;
+            for(int i = 127; i >= 0; --i)
+            {
+                rem = shl(rem, 1);
+                rem.lo |= (i >= 64 ? n.hi >> (i - 64) : n.lo >> i) & 1u;
+                if(rem >= u128{ 0, d })
+                {
+                    rem = sub(rem, { 0, d });
+                    if(i >= 64)
+                        q.hi |= std::uint64_t(1) << (i - 64);
+                    else
+                        q.lo |= std::uint64_t(1) << i;
+                }
+            }
+            return q.lo;
+        }
+
+        constexpr std::uint64_t isqrt_u128(u128 n) noexcept
+        {
+            u128 res;
+            u128 bit = { std::uint64_t(1) << 62, 0 };
+            while(bit > n)
+                bit = shr(bit, 2);
+            while(bit != u128{})
+            {
+                u128 sum = res;
+                sum.lo += bit.lo;
+                sum.hi += bit.hi + (sum.lo < bit.lo ? 1 : 0);
+                if(n >= sum)
+                {
+                    n = sub(n, sum);
+                    res = shr(res, 1);
+                    res.lo += bit.lo;
+                    res.hi += bit.hi + (res.lo < bit.lo ? 1 : 0);
+                }
+                else
+                    res = shr(res, 1);
+                bit = shr(bit, 2);
+            }
+            return res.lo;
+        }
+
+        template <typename Int>
+        struct fixed_traits;
+        template <>
+        struct fixed_traits<std::int32_t>
+        {
+            typedef std::int64_t wide_type;
+        };
+        template <>
+        struct fixed_traits<std::int64_t>
+        {
+            typedef void wide_type; // no portable 128-bit type
+        };
+
+        // sin(x) for x in [0, pi/2] in Q2.30, computed with integers only
+        // so the table is identical on every compiler
+        constexpr std::int32_t sin_q30(std::int64_t x) noexcept
+        {
+            std::int64_t x2 = (x * x) >> 30;
+            std::int64_t term = x;
+            std::int64_t sum = x;
+            for(int k = 1; k < 10; ++k)
+            {
+                term = -((term * x2) >> 30) / ((2 * k) * (2 * k + 1));
+                sum += term;
+            }
+            return static_cast<std::int32_t>(sum > (std::int64_t(1) << 30) ? (std::int64_t(1) << 30) : sum);
+        }
+
+        constexpr std::size_t sin_table_bits = 10;
+        constexpr std::size_t sin_table_size = std::size_t(1) << sin_table_bits;
+
+        // Quarter wave with one extra entry for the interpolation at pi/2
+        constexpr auto sin_table = []() {
+            constexpr std::int64_t half_pi_q30 = 1686629713;
+            std::array<std::int32_t, sin_table_size + 1> table{};
+            for(std::size_t i = 0; i <= sin_table_size; ++i)
+                table[i] = sin_q30((static_cast<std::int64_t>(i) * half_pi_q30 + sin_table_size / 2) >> sin_table_bits);
+            table[sin_table_size] = 1 << 30;
+            return table;
+        }();
+    }
+
+    //  Signed fixed-point number with FracBits fractional bits.
+    //  All operations are integer only, so results are bit-identical across
+    //  compilers and platforms. Overflow wraps around like unsigned integers.
+    template <typename Int, int FracBits>
+    class fixed
+    {
+    public:
+        typedef Int raw_type;
+        static constexpr int frac_bits = FracBits;
+        static constexpr Int one_raw = Int(1) << FracBits;
+
+        static_assert(std::is_signed_v<Int>);
+        static_assert(FracBits > 0 && FracBits < static_cast<int>(sizeof(Int) * 8) - 1);
+
+        constexpr fixed() noexcept = default;
+
+        template <typename I>
+            requires std::is_integral_v<I>
+        constexpr fixed(I i) noexcept
+            : m_raw(static_cast<Int>(static_cast<std::make_unsigned_t<Int>>(i) << FracBits)) {}
+
+        static constexpr fixed from_raw(Int raw) noexcept
+        {
+            fixed f;
+            f.m_raw = raw;
+            return f;
+        }
+        // Exact for compile-time constants since the scaling is a power of two.
+        // Don't use it on values computed at runtime in the simulation.
+        static constexpr fixed from_double(double d) noexcept
+        {
+            return from_raw(static_cast<Int>(d * static_cast<double>(one_raw)));
+        }
+        static constexpr fixed from_ratio(Int num, Int den) noexcept
+        {
+            return fixed(num) / fixed(den);
+        }
+
+        constexpr Int raw() const noexcept { return m_raw; }
+        // Rounds toward negative infinity
+        constexpr Int to_int() const noexcept { return m_raw >> FracBits; }
+        // For rendering and diagnostics only
+        constexpr double to_double() const noexcept
+        {
+            return static_cast<double>(m_raw) / static_cast<double>(one_raw);
+        }
+
+        static constexpr fixed max() noexcept { return from_raw(std::numeric_limits<Int>::max()); }
+        static constexpr fixed min() noexcept { return from_raw(std::numeric_limits<Int>::min()); }
+
+        friend constexpr fixed operator+(fixed l, fixed r) noexcept
+        {
+            return from_raw(static_cast<Int>(static_cast<U>(l.m_raw) + static_cast<U>(r.m_raw)));
+        }
+        friend constexpr fixed operator-(fixed l, fixed r) noexcept
+        {
+            return from_raw(static_cast<Int>(static_cast<U>(l.m_raw) - static_cast<U>(r.m_raw)));
+        }
+        constexpr fixed operator-() const noexcept
+        {
+            return from_raw(static_cast<Int>(U(0) - static_cast<U>(m_raw)));
+        }
+
+        // Rounds toward negative infinity
+        friend constexpr fixed operator*(fixed l, fixed r) noexcept
+        {
+            if constexpr(!std::is_void_v<wide_type>)
+            {
+                return from_raw(static_cast<Int>((static_cast<wide_type>(l.m_raw) * r.m_raw) >> FracBits));
+            }
+            else
+            {
+                bool negative = (l.m_raw < 0) != (r.m_raw < 0);
+                auto p = detailed::mul_u64(abs_raw(l.m_raw), abs_raw(r.m_raw));
+                if(negative)
+                    p = detailed::neg(p);
+                // Arithmetic shift of the 128-bit product
+                std::uint64_t lo = (p.lo >> FracBits) | (p.hi << (64 - FracBits));
+                return from_raw(static_cast<Int>(lo));
+            }
+        }
+
+        // Rounds toward zero, division by zero saturates
+        friend constexpr fixed operator/(fixed l, fixed r) noexcept
+        {
+            if(r.m_raw == 0)
+                return l.m_raw < 0 ? min() : max();
+            if constexpr(!std::is_void_v<wide_type>)
+            {
+                wide_type n = static_cast<wide_type>(static_cast<std::make_unsigned_t<wide_type>>(l.m_raw) << FracBits);
+                return from_raw(static_cast<Int>(n / r.m_raw));
+            }
+            else
+            {
+                bool negative = (l.m_raw < 0) != (r.m_raw < 0);
+                auto n = detailed::shl({ 0, abs_raw(l.m_raw) }, FracBits);
+                std::uint64_t q = detailed::div_u128(n, abs_raw(r.m_raw));
+                return from_raw(static_cast<Int>(negative ? 0 - q : q));
+            }
+        }
+
+        constexpr fixed& operator+=(fixed r) noexcept { return *this = *this + r; }
+        constexpr fixed& operator-=(fixed r) noexcept { return *this = *this - r; }
+        constexpr fixed& operator*=(fixed r) noexcept { return *this = *this * r; }
+        constexpr fixed& operator/=(fixed r) noexcept { return *this = *this / r; }
+
+        friend constexpr bool operator==(fixed, fixed) noexcept = default;
+        friend constexpr auto operator<=>(fixed, fixed) noexcept = default;
+
+    private:
+        typedef std::make_unsigned_t<Int> U;
+        typedef typename detailed::fixed_traits<Int>::wide_type wide_type;
+
+        Int m_raw = 0;
+
+        static constexpr U abs_raw(Int v) noexcept
+        {
+            return v < 0 ? U(0) - static_cast<U>(v) : static_cast<U>(v);
+        }
+    };
+
+    typedef fixed<std::int32_t, 16> q16_16;
+    typedef fixed<std::int64_t, 32> q32_32;
+
+    // Binary angle, 65536 units per turn
+    typedef std::uint16_t angle_t;
+
+    template <typename F>
+    constexpr F sin(angle_t a) noexcept
+    {
+        constexpr unsigned int quarter = 1u << 14;
+        constexpr unsigned int frac_bits = 14 - detailed::sin_table_bits;
+
+        unsigned int quadrant = a >> 14;
+        unsigned int p = a & (quarter - 1);
+        if(quadrant & 1)
+            p = quarter - p;
+        unsigned int idx = p >> frac_bits;
+        unsigned int frac = p & ((1u << frac_bits) - 1);
+
+        std::int64_t v0 = detailed::sin_table[idx];
+        std::int64_t v1 = detailed::sin_table[idx < detailed::sin_table_size ? idx + 1 : idx];
+        std::int64_t v = v0 + (((v1 - v0) * frac) >> frac_bits);
+        if(quadrant & 2)
+            v = -v;
+
+        // Table values are Q2.30
+        if constexpr(F::frac_bits <= 30)
+        {
+            constexpr int shift = 30 - F::frac_bits;
+            if constexpr(shift == 0)
+                return F::from_raw(static_cast<typename F::raw_type>(v));
+            else
+                return F::from_raw(static_cast<typename F::raw_type>((v + (std::int64_t(1) << (shift - 1))) >> shift));
+        }
+        else
+            return F::from_raw(static_cast<typename F::raw_type>(v * (std::int64_t(1) << (F::frac_bits - 30))));
+    }
+    template <typename F>
+    constexpr F cos(angle_t a) noexcept
+    {
+        return sin<F>(static_cast<angle_t>(a + (1u << 14)));
+    }
+
+    constexpr std::uint32_t isqrt(std::uint64_t n) noexcept
+    {
+        return static_cast<std::uint32_t>(detailed::isqrt_u128({ 0, n }));
+    }
+
+    // Negative values give zero
+    template <typename Int, int FracBits>
+    constexpr fixed<Int, FracBits> sqrt(fixed<Int, FracBits> f) noexcept
+    {
+        if(f.raw() <= 0)
+            return {};
+        auto n = detailed::shl({ 0, static_cast<std::uint64_t>(f.raw()) }, FracBits);
+        return fixed<Int, FracBits>::from_raw(static_cast<Int>(detailed::isqrt_u128(n)));
+    }
+
+    //  Element-wise operations over arrays of fixed-point values, out may be
+    //  the same array as a or b. fixed_add is a plain integer add and
+    //  vectorizes for every format. fixed_mul and fixed_mul_add only do for
+    //  q16_16 on targets with wide 64-bit multiplies such as AVX2, a q32_32
+    //  product takes 128 bits. fixed_div branches on zero and divides one
+    //  element at a time.
+    template <typename F>
+    void fixed_add(const F* a, const F* b, F* out, std::size_t n) noexcept
+    {
+        for(std::size_t i = 0; i < n; ++i)
+            out[i] = a[i] + b[i];
+    }
+    template <typename F>
+    void fixed_mul(const F* a, const F* b, F* out, std::size_t n) noexcept
+    {
+        for(std::size_t i = 0; i < n; ++i)
+            out[i] = a[i] * b[i];
+    }
+    template <typename F>
+    void fixed_div(const F* a, const F* b, F* out, std::size_t n) noexcept
+    {
+        for(std::size_t i = 0; i < n; ++i)
+            out[i] = a[i] / b[i];
+    }
+    // out[i] = a[i] + b[i] * s
+    template <typename F>
+    void fixed_mul_add(const F* a, const F* b, F s, F* out, std::size_t n) noexcept
+    {
+        for(std::size_t i = 0; i < n; ++i)
+            out[i] = a[i] + b[i] * s;
+    }
+}
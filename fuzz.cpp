@@ -0,0 +1,214 @@
+#include "fuzz.hpp"
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include "input_source.hpp"
+#include "random.hpp"
+#include "session.hpp"
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        //  One direction of the simulated connection
+        class fuzz_link
+        {
+        public:
+            explicit fuzz_link(std::uint64_t seed, unsigned int max_latency)
+                : m_rand(seed), m_max_latency(max_latency) {}
+
+            void send_input(std::uint64_t tick, std::uint64_t frame, int player, input_mask keys)
+            {
+                push(tick, { frame, player, keys, 0, false });
+            }
+            void send_checksum(std::uint64_t tick, std::uint64_t frame, std::uint64_t checksum)
+            {
+                push(tick, { frame, 0, 0, checksum, true });
+            }
+
+            void deliver(std::uint64_t tick, rollback_session& to)
+            {
+                while(!m_queue.empty() && m_queue.front().first <= tick)
+                {
+                    auto& m = m_queue.front().second;
+                    if(m.is_checksum)
+                        to.add_remote_checksum(m.frame, m.checksum);
+                    else
+                        to.add_remote_input(m.frame, m.player, m.keys);
+                    m_queue.pop_front();
+                }
+            }
+
+        private:
+            struct message
+            {
+                std::uint64_t frame;
+                int player;
+                input_mask keys;
+                std::uint64_t checksum;
+                bool is_checksum;
+            };
+
+            rng m_rand;
+            unsigned int m_max_latency;
+            // Ordered by arrival, the connection is reliable and in order
+            std::deque<std::pair<std::uint64_t, message>> m_queue;
+
+            void push(std::uint64_t tick, const message& m)
+            {
+                std::uint64_t arrival = tick + m_rand.bounded(m_max_latency + 1);
+                if(!m_queue.empty())
+                    arrival = std::max(arrival, m_queue.back().first);
+                m_queue.emplace_back(arrival, m);
+            }
+        };
+    }
+
+    std::optional<fuzz_failure> fuzz_case(unsigned int seed, const fuzz_options& opts)
+    {
+        rng case_rand(seed);
+        const unsigned int latency = case_rand.bounded(opts.max_latency + 1);
+        const unsigned int delay = case_rand.bounded(opts.input_delay + 1);
+
+        std::array<rollback_session, max_players> peers{
+            rollback_session(seed, 0, delay, opts.speculate ? speculation::branch_count : 0),
+            rollback_session(seed, 1, delay, opts.speculate ? speculation::branch_count : 0)
+        };
+        std::array<detailed::fuzz_link, max_players> links{
+            detailed::fuzz_link(case_rand(), latency),
+            detailed::fuzz_link(case_rand(), latency)
+        };
+        std::array<random_input_source, max_players> inputs{
+            random_input_source(case_rand()),
+            random_input_source(case_rand())
+        };
+
+        std::uint64_t tick = 0;
+        std::optional<std::uint64_t> peer_desync;
+        for(std::size_t i = 0; i < max_players; ++i)
+        {
+            auto& link = links[i];
+            peers[i].game()->spawn_entities(opts.entities);
+            peers[i].on_send_input.connect([&link, &tick](std::uint64_t f, int p, input_mask k) {
+                link.send_input(tick, f, p, k);
+            });
+            peers[i].on_send_checksum.connect([&link, &tick](std::uint64_t f, std::uint64_t c) {
+                link.send_checksum(tick, f, c);
+            });
+            peers[i].on_desync.connect([&peer_desync](std::uint64_t f) {
+                peer_desync = std::min(peer_desync.value_or(f), f);
+            });
+        }
+
+        // Enough ticks to confirm every frame even when stalling on latency
+        const std::uint64_t max_ticks = opts.frames * (latency + 2) + 64;
+        for(; tick < max_ticks; ++tick)
+        {
+            if(std::all_of(
+                peers.begin(),
+                peers.end(),
+                [&opts](const auto& p) { return p.confirmed_frames() >= opts.frames; }
+            )) {
+                break;
+            }
+
+            for(std::size_t i = 0; i < max_players; ++i)
+                links[i].deliver(tick, peers[1 - i]);
+            for(std::size_t i = 0; i < max_players; ++i)
+                peers[i].advance(inputs[i].next()->keys[i]);
+
+            // Moves the delay one frame at a time, like delay_controller
+            if(tick % 60 == 59)
+            {
+                for(auto& p : peers)
+                {
+                    unsigned int d = p.input_delay();
+                    if(case_rand.bounded(2) == 0)
+                        d = d < opts.input_delay ? d + 1 : d;
+                    else
+                        d = d > 0 ? d - 1 : d;
+                    p.set_input_delay(d);
+                }
+            }
+            if(peer_desync)
+                return fuzz_failure{ seed, "rollback", *peer_desync };
+        }
+        for(auto& p : peers)
+        {
+            if(p.confirmed_frames() < opts.frames)
+                return fuzz_failure{ seed, "stall", p.confirmed_frames() };
+        }
+
+        // The same inputs again, without prediction or rollback
+        auto dump = peers[0].make_dump();
+        std::array<std::vector<std::uint64_t>, max_players> checksums{
+            std::move(dump.checksums),
+            peers[1].make_dump().checksums
+        };
+
+        game_world plain(seed);
+        plain.spawn_entities(opts.entities);
+        for(std::uint64_t f = 0; f < dump.inputs.size(); ++f)
+        {
+            plain.apply_input(dump.inputs[f]);
+            plain.update();
+
+            std::uint64_t checksum = plain.checksum();
+            for(auto& c : checksums)
+            {
+                if(f < c.size() && c[f] != checksum)
+                    return fuzz_failure{ seed, "rollback/plain", f };
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    void fuzz_harness::run(
+        std::uint64_t master_seed,
+        std::uint64_t cases,
+        unsigned int threads,
+        std::optional<std::chrono::steady_clock::time_point> deadline
+    ) {
+        m_stop = false;
+        m_next_case = 0;
+
+        auto work = [&] {
+            while(!m_stop)
+            {
+                if(deadline && std::chrono::steady_clock::now() >= *deadline)
+                    break;
+                std::uint64_t n = m_next_case.fetch_add(1, std::memory_order_relaxed);
+                if(cases != 0 && n >= cases)
+                    break;
+
+                auto failure = fuzz_case(fuzz_case_seed(master_seed, n), m_opts);
+                m_cases_run.fetch_add(1, std::memory_order_relaxed);
+                if(failure)
+                {
+                    std::lock_guard guard(m_mutex);
+                    m_failures.push_back(*failure);
+                    on_failure(*failure);
+                }
+            }
+        };
+
+        std::vector<std::jthread> workers;
+        workers.reserve(threads);
+        for(unsigned int i = 0; i < std::max(threads, 1u); ++i)
+            workers.emplace_back(work);
+    }
+
+    std::vector<fuzz_failure> fuzz_harness::failures() const
+    {
+        std::lock_guard guard(m_mutex);
+        return m_failures;
+    }
+
+    unsigned int fuzz_case_seed(std::uint64_t master_seed, std::uint64_t n) noexcept
+    {
+        rng r(master_seed ^ (n * 0x9E3779B97F4A7C15ull));
+        return r();
+    }
+}
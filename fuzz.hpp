@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <boost/signals2.hpp>
+
+
+namespace awe
+{
+    struct fuzz_options
+    {
+        std::uint64_t frames = 1800;
+        std::uint64_t entities = 256;
+        // Random one-way latency of the simulated link, in ticks
+        unsigned int max_latency = 8;
+        // Upper bound of the input delay, which changes during a case
+        unsigned int input_delay = 2;
+        // Let the peers adopt speculative branches, the timing of their
+        // worker threads is not reproducible
+        bool speculate = false;
+    };
+
+    struct fuzz_failure
+    {
+        unsigned int seed = 0;
+        // "rollback", "rollback/plain", or "stall" when the peers didn't
+        // confirm every frame in time, frame is the last one confirmed then
+        std::string kind;
+        std::uint64_t frame = 0;
+    };
+
+    //  One case, fully determined by the seed:
+    //  two rollback peers exchange inputs over a link with random latency,
+    //  then a plain world replays the confirmed inputs without rollback.
+    //  Its checksums are compared with the ones of both peers after every
+    //  frame. The peers have to confirm every frame within a bounded
+    //  number of ticks, a stall fails the case too.
+    std::optional<fuzz_failure> fuzz_case(unsigned int seed, const fuzz_options& opts);
+
+    //  Runs cases on every core until stopped
+    class fuzz_harness
+    {
+    public:
+        explicit fuzz_harness(fuzz_options opts)
+            : m_opts(opts) {}
+
+        // Blocks until the given number of cases have run (0 for no limit),
+        // the deadline has passed or stop() is called
+        void run(
+            std::uint64_t master_seed,
+            std::uint64_t cases,
+            unsigned int threads,
+            std::optional<std::chrono::steady_clock::time_point> deadline
+        );
+        void stop() noexcept { m_stop = true; }
+
+        std::uint64_t cases_run() const noexcept { return m_cases_run.load(std::memory_order_relaxed); }
+        std::vector<fuzz_failure> failures() const;
+
+        // Called from the worker threads, one call at a time
+        boost::signals2::signal<void(const fuzz_failure&)> on_failure;
+
+    private:
+        fuzz_options m_opts;
+        std::atomic_bool m_stop = false;
+        std::atomic<std::uint64_t> m_next_case = 0;
+        std::atomic<std::uint64_t> m_cases_run = 0;
+
+        mutable std::mutex m_mutex;
+        std::vector<fuzz_failure> m_failures;
+    };
+
+    // Seed of the n-th case of a run
+    unsigned int fuzz_case_seed(std::uint64_t master_seed, std::uint64_t n) noexcept;
+}
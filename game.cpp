@@ -1,4 +1,5 @@
 #include "game.hpp"
+#include <algorithm>
 
 
 namespace awe
@@ -6,14 +7,402 @@ namespace awe
     game_world::game_world(unsigned int seed)
         : m_rand(seed) {}
 
+    void game_world::apply_input(const frame_input& input)
+    {
+        for(std::size_t i = 0; i < input.keys.size(); ++i)
+        {
+            for(auto dir : { cmd::MV_UP, cmd::MV_DOWN, cmd::MV_LEFT, cmd::MV_RIGHT })
+            {
+                if(input.keys[i] & to_mask(dir))
+                    add_command(cmd::move{ static_cast<std::int32_t>(i), dir });
+            }
+        }
+    }
+
     void game_world::update()
     {
         if(completed())
+        {
+            m_cmds = {};
             return;
+        }
+
+        steer_table steer_x{}, steer_y{};
+        while(!m_cmds.empty())
+        {
+            std::visit([&](const cmd::move& mv) {
+                if(mv.player_id < 0 || static_cast<std::size_t>(mv.player_id) >= m_players.size())
+                    return;
+                auto& p = m_players[mv.player_id];
+                auto& sx = steer_x[mv.player_id + 1];
+                auto& sy = steer_y[mv.player_id + 1];
+                switch(mv.dir)
+                {
+                case cmd::MV_UP: p.y -= player_speed; sy -= steer_accel; break;
+                case cmd::MV_DOWN: p.y += player_speed; sy += steer_accel; break;
+                case cmd::MV_LEFT: p.x -= player_speed; sx -= steer_accel; break;
+                case cmd::MV_RIGHT: p.x += player_speed; sx += steer_accel; break;
+                }
+            }, m_cmds.front());
+            m_cmds.pop();
+        }
+
+        update_entities(steer_x, steer_y);
+
         m_framecount += 1;
     }
 
-    void game_world::render(SDL_Renderer* ren)
+    void game_world::spawn_entities(std::size_t count)
+    {
+        const auto speed_range = static_cast<std::uint32_t>(2 * max_entity_speed.raw() + 1);
+        auto random_speed = [&]() {
+            return q16_16::from_raw(static_cast<std::int32_t>(m_rand.bounded(speed_range)) - max_entity_speed.raw());
+        };
+
+        m_entities.reserve(m_entities.size() + count);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            auto x = q16_16::from_raw(static_cast<std::int32_t>(m_rand.bounded(world_size.raw())));
+            auto y = q16_16::from_raw(static_cast<std::int32_t>(m_rand.bounded(world_size.raw())));
+            auto vx = random_speed();
+            auto vy = random_speed();
+            auto owner = static_cast<std::int8_t>(i % (max_players + 1)) - 1;
+            auto h = m_entities.create(x, y, vx, vy, static_cast<std::int8_t>(owner), entity_storage::FLAG_SOLID);
+            m_grid.insert(h.slot, x, y);
+        }
+        m_hasher.mark_all_dirty();
+    }
+
+    void game_world::update_entities(const steer_table& steer_x, const steer_table& steer_y)
+    {
+        const std::size_t n = m_entities.size();
+        q16_16* px = m_entities.pos_x().data();
+        q16_16* py = m_entities.pos_y().data();
+        q16_16* vx = m_entities.vel_x().data();
+        q16_16* vy = m_entities.vel_y().data();
+        const std::int8_t* owner = m_entities.owner().data();
+
+        // Entities move independently of each other,
+        // so any partition of them gives the same result
+        const std::size_t tasks = m_pool && n >= parallel_threshold ? m_pool->size() * 4 : 1;
+        if(m_bounced.size() < tasks)
+            m_bounced.resize(tasks);
+        run_tasks(tasks, [&](std::size_t t) {
+            auto [begin, end] = partition_range(n, tasks, t);
+
+            // Steering, then speed limit
+            for(std::size_t i = begin; i < end; ++i)
+            {
+                vx[i] = std::clamp(vx[i] + steer_x[owner[i] + 1], -max_entity_speed, max_entity_speed);
+                vy[i] = std::clamp(vy[i] + steer_y[owner[i] + 1], -max_entity_speed, max_entity_speed);
+            }
+
+            fixed_add(px + begin, vx + begin, px + begin, end - begin);
+            fixed_add(py + begin, vy + begin, py + begin, end - begin);
+
+            // Bounce on the borders
+            const q16_16 zero;
+            auto& bounced = m_bounced[t];
+            bounced.clear();
+            for(std::size_t i = begin; i < end; ++i)
+            {
+                bool out_x = px[i] < zero || px[i] > world_size;
+                bool out_y = py[i] < zero || py[i] > world_size;
+                if(out_x || out_y)
+                    bounced.push_back(static_cast<std::uint32_t>(i));
+                vx[i] = out_x ? -vx[i] : vx[i];
+                vy[i] = out_y ? -vy[i] : vy[i];
+                px[i] = std::clamp(px[i], zero, world_size);
+                py[i] = std::clamp(py[i], zero, world_size);
+            }
+        });
+
+        // Every moving entity writes its position, the velocities only
+        // change under steering and at the borders
+        mark_written(entity_storage::COMP_POS_X, 0, n);
+        mark_written(entity_storage::COMP_POS_Y, 0, n);
+        auto steers = [](const steer_table& steer) {
+            return std::any_of(steer.begin(), steer.end(), [](q16_16 s) { return s != q16_16(); });
+        };
+        if(steers(steer_x))
+            mark_written(entity_storage::COMP_VEL_X, 0, n);
+        if(steers(steer_y))
+            mark_written(entity_storage::COMP_VEL_Y, 0, n);
+        for(std::size_t t = 0; t < tasks; ++t)
+        {
+            for(auto i : m_bounced[t])
+            {
+                mark_written(entity_storage::COMP_VEL_X, i, i + 1);
+                mark_written(entity_storage::COMP_VEL_Y, i, i + 1);
+            }
+        }
+
+        const std::uint32_t* slots = m_entities.slots().data();
+        for(std::size_t i = 0; i < n; ++i)
+            m_grid.update(slots[i], px[i], py[i]);
+
+        resolve_collisions(tasks);
+    }
+
+    void game_world::resolve_collisions(std::size_t tasks)
+    {
+        const q16_16* px = m_entities.pos_x().data();
+        const q16_16* py = m_entities.pos_y().data();
+        q16_16* vx = m_entities.vel_x().data();
+        q16_16* vy = m_entities.vel_y().data();
+        const std::uint8_t* flags = m_entities.flags().data();
+        constexpr q16_16 min_dist = entity_radius + entity_radius;
+        constexpr q16_16 min_dist2 = min_dist * min_dist;
+
+        // Finding the close pairs only reads the positions, which collisions
+        // don't change, so the bands of rows are searched in parallel
+        const std::uint32_t rows = m_grid.cells_per_side();
+        const std::size_t bands = std::min<std::size_t>(tasks, rows);
+        if(m_contacts.size() < bands)
+            m_contacts.resize(bands);
+        run_tasks(bands, [&](std::size_t band) {
+            auto [begin, end] = partition_range(rows, bands, band);
+            auto& contacts = m_contacts[band];
+            contacts.clear();
+            m_grid.for_each_pair(
+                static_cast<std::uint32_t>(begin),
+                static_cast<std::uint32_t>(end),
+                [&](std::uint32_t slot_a, std::uint32_t slot_b) {
+                    std::size_t a = m_entities.index_of_slot(slot_a);
+                    std::size_t b = m_entities.index_of_slot(slot_b);
+                    if(!(flags[a] & flags[b] & entity_storage::FLAG_SOLID))
+                        return;
+                    q16_16 dx = px[b] - px[a];
+                    q16_16 dy = py[b] - py[a];
+                    if(dx * dx + dy * dy < min_dist2)
+                        contacts.emplace_back(static_cast<std::uint32_t>(a), static_cast<std::uint32_t>(b));
+                }
+            );
+        });
+
+        // A velocity can change in several pairs, so they are resolved on
+        // this thread. Taking the bands in order keeps the pair order of the
+        // grid, so the result doesn't depend on the number of bands or on
+        // whether the world was just rolled back.
+        for(std::size_t band = 0; band < bands; ++band)
+        {
+            for(auto [a, b] : m_contacts[band])
+            {
+                q16_16 dx = px[b] - px[a];
+                q16_16 dy = py[b] - py[a];
+                // Only when approaching, equal masses exchange their velocities
+                if((vx[b] - vx[a]) * dx + (vy[b] - vy[a]) * dy >= q16_16())
+                    continue;
+                std::swap(vx[a], vx[b]);
+                std::swap(vy[a], vy[b]);
+                for(auto c : { entity_storage::COMP_VEL_X, entity_storage::COMP_VEL_Y })
+                {
+                    mark_written(c, a, a + 1);
+                    mark_written(c, b, b + 1);
+                }
+            }
+        }
+    }
+
+    void game_world::mark_written(entity_storage::component c, std::size_t begin, std::size_t end)
+    {
+        const std::size_t offset = header_size() + m_entities.state_offset(c);
+        m_hasher.mark_dirty(offset + begin * sizeof(q16_16), offset + end * sizeof(q16_16));
+    }
+
+    void game_world::run_tasks(std::size_t tasks, const std::function<void(std::size_t)>& f)
+    {
+        if(m_pool)
+            m_pool->parallel_for(tasks, f);
+        else
+        {
+            for(std::size_t i = 0; i < tasks; ++i)
+                f(i);
+        }
+    }
+
+    void game_world::publish_snapshot()
+    {
+        auto& snap = m_snapshots.back();
+        snap.frame = m_framecount;
+        snap.players = m_players;
+        snap.x.assign(m_entities.pos_x().begin(), m_entities.pos_x().end());
+        snap.y.assign(m_entities.pos_y().begin(), m_entities.pos_y().end());
+        snap.owner.assign(m_entities.owner().begin(), m_entities.owner().end());
+        snap.handles.resize(m_entities.size());
+        for(std::size_t i = 0; i < m_entities.size(); ++i)
+            snap.handles[i] = m_entities.handle_at(i);
+        m_snapshots.publish();
+    }
+
+    render_stats game_world::render(SDL_Renderer* ren, const texture_atlas* atlas, float alpha)
+    {
+        // The snapshot read last time becomes the previous one. It can only be
+        // copied before the read, the writer may reuse its buffer afterwards.
+        const bool fresh = m_snapshots.has_new();
+        if(fresh)
+        {
+            const auto& last = m_snapshots.front();
+            m_previous.frame = last.frame;
+            m_previous.players = last.players;
+            m_previous.x.assign(last.x.begin(), last.x.end());
+            m_previous.y.assign(last.y.begin(), last.y.end());
+            m_previous.handles.assign(last.handles.begin(), last.handles.end());
+
+            std::uint32_t slots = 0;
+            for(auto& h : m_previous.handles)
+                slots = std::max(slots, h.slot + 1);
+            m_previous_index.assign(slots, no_previous);
+            for(std::size_t i = 0; i < m_previous.handles.size(); ++i)
+                m_previous_index[m_previous.handles[i].slot] = static_cast<std::uint32_t>(i);
+        }
+        const render_snapshot* last = &m_snapshots.front();
+        const auto& snap = m_snapshots.read();
+        // A snapshot published between has_new() and read() leaves a stale previous one
+        const bool interpolate =
+            (fresh || &snap == last) &&
+            snap.frame > m_previous.frame &&
+            snap.frame - m_previous.frame <= max_interpolated_frames;
+        if(!interpolate)
+            alpha = 1.0f;
+
+        int w = 0, h = 0;
+        SDL_GetRendererOutputSize(ren, &w, &h);
+        const float scale = std::min(w, h) / static_cast<float>(world_size.to_double());
+        auto to_screen = [scale](q16_16 v) {
+            return static_cast<float>(v.to_double()) * scale;
+        };
+        auto lerp = [&](q16_16 prev, q16_16 curr) {
+            const float p = to_screen(prev);
+            return p + (to_screen(curr) - p) * alpha;
+        };
+
+        enum layer : std::int32_t
+        {
+            LAYER_ENTITIES,
+            LAYER_PLAYERS
+        };
+
+        sprite_batch::sprite entity;
+        entity.layer = LAYER_ENTITIES;
+        sprite_batch::sprite player;
+        player.layer = LAYER_PLAYERS;
+        player.color = { 255, 255, 0, 255 };
+        if(atlas)
+        {
+            // Both come from the same texture, a frame stays a single draw call
+            if(auto uv = atlas->find("entity"))
+            {
+                entity.texture = atlas->texture();
+                entity.uv = *uv;
+            }
+            if(auto uv = atlas->find("player"))
+            {
+                player.texture = atlas->texture();
+                player.uv = *uv;
+                player.color = { 255, 255, 255, 255 };
+            }
+        }
+
+        m_batch.reserve(snap.x.size() + snap.players.size());
+        const float radius = std::max(0.5f, to_screen(entity_radius));
+        for(std::size_t i = 0; i < snap.x.size(); ++i)
+        {
+            // Paired by handle, an entity spawned since appears in place
+            q16_16 prev_x = snap.x[i], prev_y = snap.y[i];
+            const entity_handle h = snap.handles[i];
+            if(interpolate && h.slot < m_previous_index.size())
+            {
+                const std::uint32_t p = m_previous_index[h.slot];
+                if(p != no_previous && m_previous.handles[p] == h)
+                {
+                    prev_x = m_previous.x[p];
+                    prev_y = m_previous.y[p];
+                }
+            }
+            const float x = lerp(prev_x, snap.x[i]);
+            const float y = lerp(prev_y, snap.y[i]);
+            entity.dst = { x - radius, y - radius, radius * 2, radius * 2 };
+            m_batch.add(entity);
+        }
+        for(std::size_t i = 0; i < snap.players.size(); ++i)
+        {
+            const auto& prev = interpolate ? m_previous.players[i] : snap.players[i];
+            const float x = lerp(prev.x, snap.players[i].x);
+            const float y = lerp(prev.y, snap.players[i].y);
+            player.dst = { x - 4.0f, y - 4.0f, 8.0f, 8.0f };
+            m_batch.add(player);
+        }
+
+        return m_batch.flush(ren);
+    }
+
+    void game_world::save_header(state_writer& w) const
     {
+        w.write<std::uint64_t>(m_framecount);
+        w.write<std::uint64_t>(m_rand.state());
+        w.write<std::uint8_t>(m_completed);
+        for(auto& p : m_players)
+        {
+            w.write<std::int32_t>(p.x.raw());
+            w.write<std::int32_t>(p.y.raw());
+        }
+    }
+    void game_world::save_state(state_buffer& out) const
+    {
+        out.clear();
+        state_writer w(out);
+        save_header(w);
+        m_entities.save_state(w);
+    }
+    void game_world::load_state(std::span<const std::byte> in)
+    {
+        state_reader r(in);
+        const auto framecount = r.read<std::uint64_t>();
+        const auto rand_state = r.read<std::uint64_t>();
+        const bool completed = r.read<std::uint8_t>() != 0;
+        auto players = m_players;
+        for(auto& p : players)
+        {
+            p.x = q16_16::from_raw(r.read<std::int32_t>());
+            p.y = q16_16::from_raw(r.read<std::int32_t>());
+        }
+        m_spare_entities.load_state(r);
+
+        m_framecount = framecount;
+        m_rand.set_state(rand_state);
+        m_completed = completed;
+        m_players = players;
+        std::swap(m_entities, m_spare_entities);
+        // Rolling back rewrites the state anyway
+        m_hasher.mark_all_dirty();
+
+        m_grid.clear();
+        auto slots = m_entities.slots();
+        for(std::size_t i = 0; i < slots.size(); ++i)
+            m_grid.insert(slots[i], m_entities.pos_x()[i], m_entities.pos_y()[i]);
+        m_cmds = {};
+    }
+    std::uint64_t game_world::checksum() const
+    {
+        if constexpr(boost::endian::order::native != boost::endian::order::little)
+        {
+            save_state(m_checksum_state);
+            return m_hasher.update(m_checksum_state);
+        }
+        else
+        {
+            // The header changes every frame and is tiny, the entities are
+            // hashed in place
+            m_checksum_state.clear();
+            state_writer w(m_checksum_state);
+            save_header(w);
+            m_hasher.mark_dirty(0, m_checksum_state.size());
+
+            m_checksum_pieces.clear();
+            m_checksum_pieces.push_back(m_checksum_state);
+            m_entities.state_pieces(m_checksum_counts, m_checksum_pieces);
+            return m_hasher.update(m_checksum_pieces);
+        }
     }
 }
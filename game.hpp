@@ -4,9 +4,23 @@
 #include <vector>
 #include <variant>
 #include <array>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <queue>
 #include <random>
+#include <string>
 #include <SDL.h>
+#include "atlas.hpp"
+#include "broadphase.hpp"
+#include "checksum.hpp"
+#include "entity.hpp"
+#include "fixed.hpp"
+#include "random.hpp"
+#include "sprite_batch.hpp"
+#include "state.hpp"
+#include "thread_pool.hpp"
+#include "triple_buffer.hpp"
 
 
 namespace awe
@@ -28,6 +42,24 @@ namespace awe
         };
     }
 
+    constexpr std::size_t max_players = 2;
+
+    // One bit per cmd::move_direction
+    typedef std::uint8_t input_mask;
+
+    constexpr input_mask to_mask(cmd::move_direction dir) noexcept
+    {
+        return static_cast<input_mask>(1u << dir);
+    }
+
+    // Inputs of all players for a single frame
+    struct frame_input
+    {
+        std::array<input_mask, max_players> keys{};
+
+        friend bool operator==(const frame_input&, const frame_input&) = default;
+    };
+
     class game_world
     {
     public:
@@ -35,6 +67,39 @@ namespace awe
             cmd::move
         > cmd_t;
 
+        struct player_state
+        {
+            q16_16 x;
+            q16_16 y;
+        };
+
+        // Immutable copy of what the renderer needs from one tick
+        struct render_snapshot
+        {
+            std::uint64_t frame = 0;
+            std::array<player_state, max_players> players{};
+            std::vector<q16_16> x;
+            std::vector<q16_16> y;
+            std::vector<std::int8_t> owner;
+            // Dense indices change when entities are removed, handles don't
+            std::vector<entity_handle> handles;
+        };
+
+        static constexpr q16_16 player_speed = q16_16::from_double(1.5);
+        // Entities stay within [0, world_size] on both axes
+        static constexpr q16_16 world_size = q16_16(1024);
+        static constexpr q16_16 max_entity_speed = q16_16(4);
+        // Velocity change of owned entities per frame of input
+        static constexpr q16_16 steer_accel = q16_16::from_double(0.125);
+        static constexpr q16_16 entity_radius = q16_16(2);
+        // Snapshots further apart are jumps, e.g. seeks, and are drawn without
+        // interpolation. A step of 5 catch-up ticks at 16x replay speed is not.
+        static constexpr std::uint64_t max_interpolated_frames = 16 * 5;
+        // Broadphase cells are 8 units wide, at least the collision distance
+        static constexpr int grid_cell_bits = 3;
+        // Smaller worlds are not worth waking the workers for
+        static constexpr std::size_t parallel_threshold = 4096;
+
         game_world(unsigned int seed);
 
         template <typename Cmd>
@@ -43,19 +108,102 @@ namespace awe
             m_cmds.push(command);
         }
 
+        // Translates the key masks into commands for the next update
+        void apply_input(const frame_input& input);
+
         void update();
 
-        void render(SDL_Renderer* ren);
+        // Spawns entities at random positions using the world's generator
+        void spawn_entities(std::size_t count);
+
+        // Spreads the entity systems of update() over the pool.
+        // The state stays bit-identical to an update on a single thread.
+        void set_thread_pool(std::shared_ptr<thread_pool> pool) noexcept { m_pool = std::move(pool); }
+
+        // Simulation side, hands the current state over to render()
+        void publish_snapshot();
+        // May run on another thread than update(), only reads the latest snapshot.
+        // Always called from the same thread. The "entity" and "player" sprites
+        // of the atlas are used when it has them, solid quads otherwise.
+        // Positions are interpolated between the previous snapshot and the latest
+        // one, alpha being the fraction of the next tick already elapsed.
+        render_stats render(SDL_Renderer* ren, const texture_atlas* atlas, float alpha);
 
         auto& random_engine() noexcept { return m_rand; }
-        std::uint64_t framecount() { return m_framecount; }
+        std::uint64_t framecount() const noexcept { return m_framecount; }
 
         bool completed() const noexcept { return m_completed; }
 
+        const player_state& player(std::size_t id) const { return m_players.at(id); }
+        const entity_storage& entities() const noexcept { return m_entities; }
+        const uniform_grid& grid() const noexcept { return m_grid; }
+
+        // The state is only meaningful between two updates,
+        // when there are no pending commands
+        void save_state(state_buffer& out) const;
+        // Throws std::out_of_range if the state is damaged, the world is left untouched then
+        void load_state(std::span<const std::byte> in);
+        // state_checksum() of the saved state. Only rehashes the pages the
+        // systems marked as written since the last call, without serializing.
+        std::uint64_t checksum() const;
+        const state_hasher& hasher() const noexcept { return m_hasher; }
+
+        // Calls f(name, value) for every field of the state, used for diffing
+        template <typename F>
+        void visit_fields(F&& f) const
+        {
+            f("framecount", static_cast<std::int64_t>(m_framecount));
+            f("rng", static_cast<std::int64_t>(m_rand.state()));
+            f("completed", static_cast<std::int64_t>(m_completed));
+            for(std::size_t i = 0; i < m_players.size(); ++i)
+            {
+                std::string prefix = "player[" + std::to_string(i) + "].";
+                f(prefix + "x", static_cast<std::int64_t>(m_players[i].x.raw()));
+                f(prefix + "y", static_cast<std::int64_t>(m_players[i].y.raw()));
+            }
+            m_entities.visit_fields(f);
+        }
+
     private:
         std::uint64_t m_framecount = 0;
-        std::mt19937 m_rand;
+        rng m_rand;
         bool m_completed = false;
+        std::array<player_state, max_players> m_players{};
+        entity_storage m_entities;
+        entity_storage m_spare_entities; // loaded into, swapped in once the whole state is read
+        uniform_grid m_grid{ world_size, grid_cell_bits }; // derived from the positions
         std::queue<cmd_t> m_cmds; // commands
+        triple_buffer<render_snapshot> m_snapshots;
+        // Render thread
+        render_snapshot m_previous; // the snapshot read before the latest one
+        static constexpr std::uint32_t no_previous = std::numeric_limits<std::uint32_t>::max();
+        std::vector<std::uint32_t> m_previous_index; // slot to index in m_previous, or no_previous
+        sprite_batch m_batch;
+
+        mutable state_buffer m_checksum_state; // the header, or all of it on big-endian hosts
+        mutable std::array<std::uint32_t, 3> m_checksum_counts;
+        mutable std::vector<std::span<const std::byte>> m_checksum_pieces;
+        mutable state_hasher m_hasher; // written bytes are marked where they are written
+
+        std::shared_ptr<thread_pool> m_pool;
+        // Close pairs found in each band of grid rows, as dense indices
+        std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> m_contacts;
+        // Entities that bounced in each task
+        std::vector<std::vector<std::uint32_t>> m_bounced;
+
+        typedef std::array<q16_16, max_players + 1> steer_table;
+        // Indexed by owner + 1, so unowned entities use the first entry
+        void update_entities(const steer_table& steer_x, const steer_table& steer_y);
+        void resolve_collisions(std::size_t tasks);
+        // Marks a range of dense indices of a component for the checksum
+        void mark_written(entity_storage::component c, std::size_t begin, std::size_t end);
+        // The part of the state before the entities
+        void save_header(state_writer& w) const;
+        std::size_t header_size() const noexcept
+        {
+            return 2 * sizeof(std::uint64_t) + sizeof(std::uint8_t) + m_players.size() * 2 * sizeof(std::int32_t);
+        }
+        // Runs f(i) for i in [0, tasks) on the pool, if there is one
+        void run_tasks(std::size_t tasks, const std::function<void(std::size_t)>& f);
     };
 }
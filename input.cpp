@@ -28,4 +28,30 @@ namespace awe
 
         return std::nullopt;
     }
+
+    input_mask input_manager::poll(int player) noexcept
+    {
+        static constexpr SDL_Keycode keys[max_players][4] =
+        {
+            { SDLK_w, SDLK_s, SDLK_a, SDLK_d },
+            { SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT }
+        };
+        if(player < 0 || static_cast<std::size_t>(player) >= max_players)
+            return 0;
+
+        const Uint8* state = SDL_GetKeyboardState(nullptr);
+        input_mask mask = 0;
+        for(auto dir : { cmd::MV_UP, cmd::MV_DOWN, cmd::MV_LEFT, cmd::MV_RIGHT })
+        {
+            if(state[SDL_GetScancodeFromKey(keys[player][dir])])
+                mask |= to_mask(dir);
+        }
+        return mask;
+    }
+
+    void input_manager::latch() noexcept
+    {
+        for(std::size_t i = 0; i < max_players; ++i)
+            m_keys[i].store(poll(static_cast<int>(i)), std::memory_order_relaxed);
+    }
 }
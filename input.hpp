@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <optional>
 #include <SDL.h>
+#include "game.hpp"
 
 
 namespace awe
@@ -22,5 +25,21 @@ namespace awe
     {
     public:
         static std::optional<input_key> get_key(SDL_Keycode k) noexcept;
+
+        // Current key mask of a player from the keyboard state
+        static input_mask poll(int player) noexcept;
+
+        // Called by the main thread after processing the events,
+        // the simulation thread reads the latched keys
+        void latch() noexcept;
+        input_mask keys(int player) const noexcept
+        {
+            if(player < 0 || static_cast<std::size_t>(player) >= max_players)
+                return 0;
+            return m_keys[player].load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::array<std::atomic<input_mask>, max_players> m_keys{};
     };
 }
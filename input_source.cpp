@@ -0,0 +1,97 @@
+#include "input_source.hpp"
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+
+namespace awe
+{
+    std::optional<frame_input> random_input_source::next()
+    {
+        for(auto& k : m_last.keys)
+        {
+            if(m_rand.bounded(8) == 0)
+                k = static_cast<input_mask>(m_rand.bounded(16));
+        }
+        return m_last;
+    }
+
+    scripted_input_source::scripted_input_source(const std::filesystem::path& path)
+    {
+        std::ifstream ifs(path);
+        if(!ifs)
+            throw std::runtime_error("failed to open " + path.string());
+
+        std::string line;
+        std::size_t line_no = 0;
+        while(std::getline(ifs, line))
+        {
+            ++line_no;
+            if(line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream iss(line);
+            std::uint64_t frames = 0;
+            frame_input input;
+            iss >> frames;
+            for(auto& k : input.keys)
+            {
+                unsigned int v = 0;
+                iss >> v;
+                k = static_cast<input_mask>(v);
+            }
+            if(!iss)
+                throw std::runtime_error(path.string() + ":" + std::to_string(line_no) + ": invalid step");
+            m_steps.emplace_back(frames, input);
+        }
+    }
+
+    std::optional<frame_input> scripted_input_source::next()
+    {
+        while(m_step < m_steps.size() && m_frame_in_step >= m_steps[m_step].first)
+        {
+            ++m_step;
+            m_frame_in_step = 0;
+        }
+        if(m_step >= m_steps.size())
+            return std::nullopt;
+
+        ++m_frame_in_step;
+        return m_steps[m_step].second;
+    }
+
+    recorded_input_source::recorded_input_source(const std::filesystem::path& path)
+        : m_ifs(path, std::ios::binary)
+    {
+        if(!m_ifs)
+            throw std::runtime_error("failed to open " + path.string());
+    }
+
+    std::optional<frame_input> recorded_input_source::next()
+    {
+        frame_input input;
+        m_ifs.read(reinterpret_cast<char*>(input.keys.data()), input.keys.size());
+        if(!m_ifs)
+            return std::nullopt;
+        return input;
+    }
+
+    input_log_writer::input_log_writer(const std::filesystem::path& path, bool append)
+        : m_ofs(path, append ? std::ios::binary | std::ios::app : std::ios::binary)
+    {
+        if(!m_ofs)
+            throw std::runtime_error("failed to open " + path.string());
+    }
+
+    void input_log_writer::write(const frame_input& input)
+    {
+        m_ofs.write(reinterpret_cast<const char*>(input.keys.data()), input.keys.size());
+    }
+
+    void input_log_writer::flush()
+    {
+        m_ofs.flush();
+        if(!m_ofs)
+            throw std::runtime_error("failed to write the input log");
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
+#include "game.hpp"
+#include "random.hpp"
+
+
+namespace awe
+{
+    //  Inputs for headless runs
+    class input_source
+    {
+    public:
+        virtual ~input_source() = default;
+
+        // Inputs of the next frame, std::nullopt once exhausted
+        virtual std::optional<frame_input> next() = 0;
+    };
+
+    //  Random key presses that are held for a few frames, like a player would do
+    class random_input_source : public input_source
+    {
+    public:
+        explicit random_input_source(std::uint64_t seed)
+            : m_rand(seed) {}
+
+        std::optional<frame_input> next() override;
+
+    private:
+        rng m_rand;
+        frame_input m_last;
+    };
+
+    //  Text script, one "<frames> <keys of 1P> <keys of 2P>" line per step.
+    //  The keys are held for the given number of frames.
+    //  Empty lines and lines starting with '#' are ignored.
+    class scripted_input_source : public input_source
+    {
+    public:
+        // Throws std::runtime_error on failure
+        explicit scripted_input_source(const std::filesystem::path& path);
+
+        std::optional<frame_input> next() override;
+
+    private:
+        std::vector<std::pair<std::uint64_t, frame_input>> m_steps;
+        std::size_t m_step = 0;
+        std::uint64_t m_frame_in_step = 0;
+    };
+
+    //  Raw input log, max_players bytes per frame
+    class recorded_input_source : public input_source
+    {
+    public:
+        // Throws std::runtime_error on failure
+        explicit recorded_input_source(const std::filesystem::path& path);
+
+        std::optional<frame_input> next() override;
+
+    private:
+        std::ifstream m_ifs;
+    };
+
+    // Writes a log readable by recorded_input_source
+    class input_log_writer
+    {
+    public:
+        // Throws std::runtime_error on failure
+        explicit input_log_writer(const std::filesystem::path& path, bool append = false);
+
+        void write(const frame_input& input);
+        // Throws std::runtime_error on failure
+        void flush();
+
+    private:
+        std::ofstream m_ofs;
+    };
+}
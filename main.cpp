@@ -1,9 +1,12 @@
 #include "main.hpp"
+#include <algorithm>
+#include <string>
 #include <boost/endian.hpp>
 #include <imgui.h>
 #include <imgui_impl_sdl.h>
 #include <imgui_impl_sdlrenderer.h>
 #include "message.hpp"
+#include "cli.hpp"
 
 
 namespace awe
@@ -18,6 +21,18 @@ namespace awe
     {
         m_win = win;
         m_ren = ren;
+        try
+        {
+            const auto dir = sprite_directory();
+            m_atlas.emplace(ren, load_atlas_image(dir, atlas_cache_directory(dir)));
+        }
+        catch(const std::runtime_error& e)
+        {
+            get_chatroom().add_record(
+                std::string("Failed to load the sprites: ") + e.what(),
+                chatroom::NOTIFICATION
+            );
+        }
         m_network = std::make_shared<network>();
         m_mode_panel.set_network(m_network);
 
@@ -34,6 +49,22 @@ namespace awe
             std::lock_guard guard(start_panel.get_mutex());
             start_panel.set(get<0>(msg), get<1>(msg));
         });
+        m_network->register_msgproc<AWEMSG_GAME_START>([](const message_tuple<AWEMSG_GAME_START>::type& msg) {
+            auto& app = application::instance();
+            std::lock_guard guard(app.get_mutex());
+            app.start(std::make_shared<network_runner>(
+                app.get_network(),
+                get<0>(msg),
+                app.this_player(),
+                0,
+                app.speculate()
+            ));
+        });
+        m_network->register_msgproc<AWEMSG_GAME_RESUME>([](const message_tuple<AWEMSG_GAME_RESUME>::type& msg) {
+            auto& app = application::instance();
+            std::lock_guard guard(app.get_mutex());
+            app.resume_network_game(get<0>(msg), get<1>(msg));
+        });
         m_network->on_error.connect([](const boost::system::error_code& ec) {
             auto& app = application::instance();
             std::lock_guard guard(app.get_mutex());
@@ -52,6 +83,9 @@ namespace awe
                 net.on_error(ec);
             return !ec;
         });
+        m_replay_control.on_stop.connect([] {
+            application::instance().stop_replay();
+        });
         m_start_panel.on_change.connect([](int id, bool state)->bool {
             boost::system::error_code ec;
             auto& net = *application::instance().get_network();
@@ -68,8 +102,10 @@ namespace awe
     }
     void application::quit()
     {
+        m_sim.stop();
         m_mode_panel.set_network(nullptr);
         m_network.reset();
+        m_atlas.reset();
         m_win = nullptr;
         m_ren = nullptr;
     }
@@ -91,12 +127,16 @@ namespace awe
         {
             if(ShowStartPanel("Preparing", m_start_panel))
             {
-                
+                start_network_game();
             }
         }
         if(started())
         {
-            ShowGameControl("Game Control", m_game_control);
+            if(m_mode_panel.get_mode() == mode_panel::MODE_REPLAY)
+                ShowReplayControl("Replay", m_replay_control);
+            else
+                ShowGameControl("Game Control", m_game_control);
+            ShowRenderStats("Rendering", m_render_stats);
         }
 
         // Chatroom
@@ -104,8 +144,139 @@ namespace awe
     }
     void application::update_game()
     {
-        if(m_status != STARTED)
+        m_input.latch();
+    }
+    void application::render_game()
+    {
+        std::lock_guard guard(m_mutex);
+        if(m_status != STARTED || !m_runner)
+            return;
+        m_render_stats = m_runner->render(
+            m_ren,
+            m_atlas ? &*m_atlas : nullptr,
+            static_cast<float>(interpolation_alpha())
+        );
+    }
+
+    void application::start_network_game()
+    {
+        if(auto latest = resume_files::find_latest(this_player()))
+        {
+            boost::system::error_code ec;
+            {
+                std::lock_guard guard(m_network->get_write_mutex());
+                m_network->send_msg<AWEMSG_GAME_RESUME>({ latest->first, latest->second.available_frames() }, ec);
+            }
+            if(ec)
+                m_network->on_error(ec);
+            // Starts once the client answers
+            return;
+        }
+
+        std::random_device dev;
+        std::uint32_t seed = dev();
+
+        boost::system::error_code ec;
+        {
+            std::lock_guard guard(m_network->get_write_mutex());
+            m_network->send_msg<AWEMSG_GAME_START>({ seed }, ec);
+        }
+        if(ec)
+        {
+            m_network->on_error(ec);
+            return;
+        }
+
+        start(std::make_shared<network_runner>(m_network, seed, this_player(), 0, speculate()));
+    }
+
+    void application::resume_network_game(unsigned int seed, std::uint64_t frame)
+    {
+        frame = std::min(frame, resume_files::of(seed, this_player()).available_frames());
+        if(m_network->role() == network::ROLE_CLIENT)
+        {
+            boost::system::error_code ec;
+            {
+                std::lock_guard guard(m_network->get_write_mutex());
+                m_network->send_msg<AWEMSG_GAME_RESUME>({ seed, frame }, ec);
+            }
+            if(ec)
+            {
+                m_network->on_error(ec);
+                return;
+            }
+        }
+
+        std::shared_ptr<network_runner> r;
+        try
+        {
+            r = std::make_shared<network_runner>(m_network, seed, this_player(), frame, speculate());
+        }
+        catch(const std::exception& e)
+        {
+            get_chatroom().add_record(
+                std::string("Failed to resume: ") + e.what(),
+                chatroom::NOTIFICATION
+            );
+            reset();
             return;
+        }
+        get_chatroom().add_record(
+            "Resumed from frame " + std::to_string(frame),
+            chatroom::NOTIFICATION
+        );
+        start(std::move(r));
+    }
+
+    bool application::start_replay(const std::filesystem::path& path)
+    {
+        std::shared_ptr<replay_runner> r;
+        try
+        {
+            r = std::make_shared<replay_runner>(replay_file(path));
+        }
+        catch(const std::exception& e)
+        {
+            get_chatroom().add_record(
+                std::string("Failed to play the replay: ") + e.what(),
+                chatroom::NOTIFICATION
+            );
+            return false;
+        }
+
+        std::lock_guard guard(m_mutex);
+        m_replay_control.set_runner(r);
+        start(std::move(r));
+        return true;
+    }
+    void application::stop_replay()
+    {
+        std::lock_guard guard(m_mutex);
+        m_sim.stop();
+        m_runner.reset();
+        m_replay_control.set_runner(nullptr);
+        m_mode_panel.reset_replay();
+        m_status = MODE_SELECT;
+    }
+
+    void application::record_replay(network_runner& r)
+    {
+        try
+        {
+            auto path = make_replay_path(r.session().seed(), r.session().local_player());
+            r.record_replay(path);
+            get_chatroom().add_record(
+                "Recording to " + path.string(),
+                chatroom::NOTIFICATION
+            );
+        }
+        catch(const std::exception& e)
+        {
+            get_chatroom().add_record(
+                std::string("Failed to record the replay: ") + e.what(),
+                chatroom::NOTIFICATION
+            );
+        }
     }
 
     void application::report_error(
@@ -157,6 +328,10 @@ int main(int argc, char* argv[])
 {
     using namespace awe;
 
+    // Headless tools don't need a window
+    if(auto ret = run_tool(argc, argv))
+        return *ret;
+
     if(SDL_Init(SDL_INIT_VIDEO) < 0)
     {
         application::report_error(SDL_GetError(), "SDL_Init() failed");
@@ -235,6 +410,7 @@ int main(int argc, char* argv[])
         app.update_game();
 
         SDL_RenderClear(ren);
+        app.render_game();
         ImGui_ImplSDLRenderer_RenderDrawData(ImGui::GetDrawData());
         SDL_RenderPresent(ren);
     }
@@ -1,12 +1,15 @@
 #pragma once
 
+#include <optional>
 #include <SDL.h>
 #include <imgui.h>
 #include <imfilebrowser.h>
+#include "atlas.hpp"
 #include "network.hpp"
 #include "input.hpp"
 #include "widgets.hpp"
 #include "runner.hpp"
+#include "simulation.hpp"
 
 
 namespace awe
@@ -28,7 +31,23 @@ namespace awe
         void quit();
 
         void update_imgui();
+        // Hands the inputs of this frame over to the simulation thread
         void update_game();
+        void render_game();
+
+        // Fraction of the next tick already elapsed, for interpolating the rendering
+        double interpolation_alpha() const noexcept { return m_sim.alpha(); }
+
+        // Server side, sends the seed to the client and starts,
+        // or offers to resume the last game that didn't end
+        void start_network_game();
+        // The server offers the frames it can resume from, the client
+        // answers with the frames both can and both start from there
+        void resume_network_game(unsigned int seed, std::uint64_t frame);
+
+        // Returns false if the replay can't be loaded
+        bool start_replay(const std::filesystem::path& path);
+        void stop_replay();
 
         constexpr SDL_Window* window() const noexcept { return m_win; }
         constexpr SDL_Renderer* renderer() const noexcept { return m_ren; }
@@ -46,13 +65,22 @@ namespace awe
         {
             m_runner.swap(r);
             m_status = STARTED;
+            if(auto net = std::dynamic_pointer_cast<network_runner>(m_runner))
+            {
+                m_game_control.set_delay_controller(net->get_delay_controller());
+                if(m_mode_panel.record_replays())
+                    record_replay(*net);
+            }
+            m_sim.start(m_runner);
         }
 
         void reset()
         {
+            m_sim.stop();
             m_network->reset();
             m_mode_panel.reset_network();
             m_runner.reset();
+            m_game_control.set_delay_controller(nullptr);
             m_status = MODE_SELECT;
             clear_title_info();
         }
@@ -70,6 +98,9 @@ namespace awe
             }
         }
 
+        // Network games run speculative branches on idle cores
+        bool speculate() const noexcept { return m_mode_panel.speculate(); }
+
         std::shared_ptr<network>& get_network() noexcept { return m_network; }
 
         chatroom& get_chatroom() noexcept { return m_chtrm; }
@@ -95,6 +126,7 @@ namespace awe
         std::mutex m_mutex;
 
         void transit(app_status st);
+        void record_replay(network_runner& r);
 
         // Network
         std::shared_ptr<network> m_network;
@@ -103,8 +135,12 @@ namespace awe
         mode_panel m_mode_panel;
         start_panel m_start_panel;
         game_control m_game_control;
+        replay_control m_replay_control;
 
         std::shared_ptr<runner> m_runner;
+        render_stats m_render_stats; // of the last frame
+        std::optional<texture_atlas> m_atlas;
         input_manager m_input;
+        simulation_thread m_sim;
     };
 }
@@ -13,7 +13,12 @@ namespace awe
         AWEMSG_CHAT = 1, /* int32 id; string msg */
         AWEMSG_PLAYER_STATUS = 2, /* int32 id; int32 player_id; int8 status */
         AWEMSG_GAME_START = 3, /* int32 id; uint32 seed */
-        AWEMSG_GAME_STOP = 4 /* int32 id */
+        AWEMSG_GAME_STOP = 4, /* int32 id */
+        AWEMSG_INPUT = 5, /* int32 id; uint64 frame; int32 player_id; uint8 keys */
+        AWEMSG_CHECKSUM = 6, /* int32 id; uint64 frame; uint64 checksum */
+        AWEMSG_PING = 7, /* int32 id; uint64 time */
+        AWEMSG_PONG = 8, /* int32 id; uint64 time of the ping */
+        AWEMSG_GAME_RESUME = 9 /* int32 id; uint32 seed; uint64 frame */
     };
 
     template <message msgid>
@@ -46,12 +51,43 @@ namespace awe
     {
         using type = std::tuple<>;
     };
+    template <>
+    struct message_tuple<AWEMSG_INPUT>
+    {
+        using type = std::tuple<std::uint64_t, std::int32_t, std::uint8_t>;
+    };
+    template <>
+    struct message_tuple<AWEMSG_CHECKSUM>
+    {
+        using type = std::tuple<std::uint64_t, std::uint64_t>;
+    };
+
+    template <>
+    struct message_tuple<AWEMSG_PING>
+    {
+        using type = std::tuple<std::uint64_t>;
+    };
+    template <>
+    struct message_tuple<AWEMSG_PONG>
+    {
+        using type = std::tuple<std::uint64_t>;
+    };
+    template <>
+    struct message_tuple<AWEMSG_GAME_RESUME>
+    {
+        using type = std::tuple<std::uint32_t, std::uint64_t>;
+    };
 
     typedef std::variant<
         message_tuple<AWEMSG_SYNC>::type,
         message_tuple<AWEMSG_CHAT>::type,
         message_tuple<AWEMSG_PLAYER_STATUS>::type,
         message_tuple<AWEMSG_GAME_START>::type,
-        message_tuple<AWEMSG_GAME_STOP>::type
+        message_tuple<AWEMSG_GAME_STOP>::type,
+        message_tuple<AWEMSG_INPUT>::type,
+        message_tuple<AWEMSG_CHECKSUM>::type,
+        message_tuple<AWEMSG_PING>::type,
+        message_tuple<AWEMSG_PONG>::type,
+        message_tuple<AWEMSG_GAME_RESUME>::type
     > message_variant;
 }
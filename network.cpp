@@ -32,7 +32,7 @@ namespace awe
 
     void network::write_buf(const void* data, std::size_t len, boost::system::error_code& ec)
     {
-        m_sock.write_some(boost::asio::buffer(data, len), ec);
+        boost::asio::write(m_sock, boost::asio::buffer(data, len), ec);
     }
 
     void network::connect(
@@ -159,6 +159,71 @@ namespace awe
                 }
             }
             break;
+            case AWEMSG_GAME_START:
+            {
+                auto msg = recv_msg<AWEMSG_GAME_START>(ec);
+                if(!ec)
+                {
+                    m_callbacks[AWEMSG_GAME_START](std::move(msg));
+                }
+            }
+            break;
+            case AWEMSG_GAME_STOP:
+            {
+                auto msg = recv_msg<AWEMSG_GAME_STOP>(ec);
+                if(!ec)
+                {
+                    m_callbacks[AWEMSG_GAME_STOP](std::move(msg));
+                }
+            }
+            break;
+            case AWEMSG_INPUT:
+            {
+                auto msg = recv_msg<AWEMSG_INPUT>(ec);
+                if(!ec)
+                {
+                    m_callbacks[AWEMSG_INPUT](std::move(msg));
+                }
+            }
+            break;
+            case AWEMSG_CHECKSUM:
+            {
+                auto msg = recv_msg<AWEMSG_CHECKSUM>(ec);
+                if(!ec)
+                {
+                    m_callbacks[AWEMSG_CHECKSUM](std::move(msg));
+                }
+            }
+            break;
+            case AWEMSG_PING:
+            {
+                auto msg = recv_msg<AWEMSG_PING>(ec);
+                if(!ec)
+                {
+                    // Same payload as AWEMSG_SYNC, select the alternative by index
+                    m_callbacks[AWEMSG_PING](message_variant(std::in_place_index<AWEMSG_PING>, std::move(msg)));
+                }
+            }
+            break;
+            case AWEMSG_PONG:
+            {
+                auto msg = recv_msg<AWEMSG_PONG>(ec);
+                if(!ec)
+                {
+                    // Same payload as AWEMSG_SYNC, select the alternative by index
+                    m_callbacks[AWEMSG_PONG](message_variant(std::in_place_index<AWEMSG_PONG>, std::move(msg)));
+                }
+            }
+            break;
+            case AWEMSG_GAME_RESUME:
+            {
+                auto msg = recv_msg<AWEMSG_GAME_RESUME>(ec);
+                if(!ec)
+                {
+                    m_callbacks[AWEMSG_GAME_RESUME](std::move(msg));
+                }
+            }
+            break;
         }
     }
 }
@@ -78,7 +78,8 @@ namespace awe
                     std::byte buffer[sizeof(U)];
                 };
                 data_t data;
-                m_sock.read_some(boost::asio::buffer(data.buffer, sizeof(data.buffer)), ec);
+                // A message may arrive in several segments, read all of it
+                boost::asio::read(m_sock, boost::asio::buffer(data.buffer, sizeof(data.buffer)), ec);
                 out = boost::endian::little_to_native(data.value);
             }
             else if constexpr(std::is_same_v<U, std::string>)
@@ -89,7 +90,7 @@ namespace awe
                     return;
                 out.clear();
                 out.resize(len);
-                m_sock.read_some(boost::asio::buffer(out), ec);
+                boost::asio::read(m_sock, boost::asio::buffer(out), ec);
             }
             else
             {
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+
+namespace awe
+{
+    // PCG32 (XSH-RR) generator.
+    // Unlike std::mt19937 its whole state is a single integer, so it can be
+    // saved, restored and hashed together with the rest of the game state.
+    class rng
+    {
+    public:
+        typedef std::uint32_t result_type;
+
+        explicit rng(std::uint64_t s = 0) noexcept
+        {
+            seed(s);
+        }
+
+        void seed(std::uint64_t s) noexcept
+        {
+            m_state = 0;
+            (*this)();
+            m_state += s;
+            (*this)();
+        }
+
+        result_type operator()() noexcept
+        {
+            std::uint64_t old = m_state;
+            m_state = old * multiplier + increment;
+            auto xorshifted = static_cast<std::uint32_t>(((old >> 18u) ^ old) >> 27u);
+            auto rot = static_cast<std::uint32_t>(old >> 59u);
+            return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31u));
+        }
+
+        // Uniform integer in [0, bound) without the platform-dependent
+        // behaviour of std::uniform_int_distribution
+        result_type bounded(result_type bound) noexcept
+        {
+            if(bound == 0)
+                return 0;
+            result_type threshold = (0u - bound) % bound;
+            for(;;)
+            {
+                result_type r = (*this)();
+                if(r >= threshold)
+                    return r % bound;
+            }
+        }
+
+        static constexpr result_type min() noexcept { return 0; }
+        static constexpr result_type max() noexcept { return UINT32_MAX; }
+
+        constexpr std::uint64_t state() const noexcept { return m_state; }
+        constexpr void set_state(std::uint64_t st) noexcept { m_state = st; }
+
+    private:
+        static constexpr std::uint64_t multiplier = 6364136223846793005ull;
+        static constexpr std::uint64_t increment = 1442695040888963407ull;
+
+        std::uint64_t m_state = 0;
+    };
+}
@@ -0,0 +1,437 @@
+#include "replay.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <boost/interprocess/exceptions.hpp>
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        constexpr char replay_magic[8] = { 'A', 'W', 'E', 'R', 'E', 'P', 'L', 'Y' };
+        constexpr char replay_index_magic[8] = { 'A', 'W', 'E', 'I', 'N', 'D', 'E', 'X' };
+        constexpr char replay_chunk_tag[4] = { 'C', 'H', 'N', 'K' };
+        constexpr std::uint32_t replay_version = 6; // 3: chunks and index, 4: encoded inputs, 5: checksum, 6: metadata header
+
+        constexpr std::uint64_t pad8(std::uint64_t size) noexcept
+        {
+            return (size + 7) / 8 * 8;
+        }
+
+        replay_metadata parse_header(const replay_header& header, const std::filesystem::path& path)
+        {
+            if(!std::equal(std::begin(header.magic), std::end(header.magic), replay_magic))
+                throw std::runtime_error(path.string() + " is not a replay");
+            if(header.version != replay_version)
+                throw std::runtime_error(path.string() + " has an unsupported version");
+
+            replay_metadata meta;
+            meta.info.seed = header.seed;
+            meta.info.players = header.players;
+            meta.info.entities = header.entities;
+            if(meta.info.players == 0 || meta.info.players > max_players)
+                throw std::runtime_error(path.string() + " has an invalid player count");
+            meta.date = header.date;
+            meta.frames = header.frames;
+            if(header.flags & replay_header::HAS_CHECKSUM)
+                meta.checksum = header.checksum;
+            meta.complete = header.flags & replay_header::COMPLETE;
+            return meta;
+        }
+
+        template <typename T>
+        void append_struct(std::vector<std::byte>& buf, const T& val)
+        {
+            auto* p = reinterpret_cast<const std::byte*>(&val);
+            buf.insert(buf.end(), p, p + sizeof(T));
+        }
+    }
+
+    replay_recorder::replay_recorder(
+        const std::filesystem::path& path,
+        const replay_info& info,
+        std::uint64_t keyframe_interval,
+        replay_encoding encoding
+    ) : m_info(info),
+        m_date(std::time(nullptr)),
+        m_keyframe_interval(std::clamp<std::uint64_t>(keyframe_interval, 1, max_chunk_frames)),
+        m_encoding(encoding),
+        m_ofs(path, std::ios::binary)
+    {
+        if(!m_ofs)
+            throw std::runtime_error("failed to open " + path.string());
+        if(m_info.players == 0 || m_info.players > max_players)
+            throw std::out_of_range("player count out of range");
+
+        write_header(false);
+        if(!m_ofs)
+            throw std::runtime_error("failed to write " + path.string());
+        m_written = sizeof(replay_header);
+
+        m_front.reserve(buffer_size * 2);
+        m_back.reserve(buffer_size * 2);
+        m_writer = std::jthread([this](std::stop_token stop) { write_main(stop); });
+    }
+    replay_recorder::~replay_recorder()
+    {
+        close();
+    }
+
+    void replay_recorder::record(const frame_input& input)
+    {
+        if(m_chunk.empty())
+            begin_chunk({});
+        else if(m_frames - m_chunk_first >= m_keyframe_interval)
+        {
+            // No state was recorded for the next chunk, seeking into it starts further back
+            end_chunk();
+            begin_chunk({});
+        }
+
+        if(m_encoding == replay_encoding::raw)
+        {
+            auto* keys = reinterpret_cast<const std::byte*>(input.keys.data());
+            m_chunk.insert(m_chunk.end(), keys, keys + m_info.players);
+        }
+        else
+            m_encoder.add(input);
+        ++m_frames;
+    }
+
+    void replay_recorder::record_keyframe(std::span<const std::byte> state)
+    {
+        end_chunk();
+        begin_chunk(state);
+        m_last_keyframe = m_frames;
+    }
+
+    void replay_recorder::close()
+    {
+        if(m_closed)
+            return;
+        m_closed = true;
+
+        end_chunk();
+        const std::uint64_t index_offset = m_written;
+        for(auto& e : m_index)
+            detailed::append_struct(m_front, e);
+        replay_footer footer{};
+        footer.chunk_count = m_index.size();
+        footer.index_offset = index_offset;
+        footer.frames = m_frames;
+        std::copy(std::begin(detailed::replay_index_magic), std::end(detailed::replay_index_magic), footer.magic);
+        detailed::append_struct(m_front, footer);
+
+        hand_over();
+        {
+            std::unique_lock lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_back.empty(); });
+        }
+        m_writer.request_stop();
+        m_writer.join();
+
+        if(!m_failed)
+        {
+            m_ofs.seekp(0);
+            write_header(true);
+        }
+        m_ofs.close();
+        if(!m_ofs)
+            m_failed = true;
+    }
+
+    void replay_recorder::write_header(bool complete)
+    {
+        replay_header header{};
+        std::copy(std::begin(detailed::replay_magic), std::end(detailed::replay_magic), header.magic);
+        header.version = detailed::replay_version;
+        header.seed = m_info.seed;
+        header.players = m_info.players;
+        header.entities = m_info.entities;
+        header.date = m_date;
+        if(complete)
+        {
+            header.flags = replay_header::COMPLETE;
+            header.frames = m_frames;
+            if(m_checksum)
+            {
+                header.flags = header.flags | replay_header::HAS_CHECKSUM;
+                header.checksum = *m_checksum;
+            }
+        }
+        m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    void replay_recorder::begin_chunk(std::span<const std::byte> state)
+    {
+        m_chunk_first = m_frames;
+        m_chunk.assign(sizeof(replay_chunk_header), std::byte(0));
+        m_chunk.insert(m_chunk.end(), state.begin(), state.end());
+        m_chunk.resize(sizeof(replay_chunk_header) + detailed::pad8(state.size()));
+
+        replay_chunk_header header{};
+        std::copy(std::begin(detailed::replay_chunk_tag), std::end(detailed::replay_chunk_tag), header.tag);
+        header.first_frame = m_chunk_first;
+        header.state_size = state.size();
+        std::memcpy(m_chunk.data(), &header, sizeof(header));
+    }
+
+    void replay_recorder::end_chunk()
+    {
+        if(m_chunk.empty())
+            return;
+
+        replay_chunk_header header;
+        std::memcpy(&header, m_chunk.data(), sizeof(header));
+        const std::size_t inputs_offset = sizeof(header) + detailed::pad8(header.state_size);
+        header.encoding = static_cast<std::uint32_t>(m_encoding);
+        if(m_encoding != replay_encoding::raw)
+        {
+            m_encoder.flush();
+            header.encoding = static_cast<std::uint32_t>(replay_encoding::packed_rle);
+        }
+        if(m_encoding == replay_encoding::packed_rle_lz)
+        {
+            m_lz.clear();
+            lz_compress(std::span(m_chunk).subspan(inputs_offset), m_lz);
+            if(m_lz.size() < m_chunk.size() - inputs_offset)
+            {
+                m_chunk.resize(inputs_offset);
+                m_chunk.insert(m_chunk.end(), m_lz.begin(), m_lz.end());
+                header.encoding = static_cast<std::uint32_t>(replay_encoding::packed_rle_lz);
+            }
+        }
+        header.frames = static_cast<std::uint32_t>(m_frames - m_chunk_first);
+        header.input_size = static_cast<std::uint32_t>(m_chunk.size() - inputs_offset);
+        std::memcpy(m_chunk.data(), &header, sizeof(header));
+        m_chunk.resize(detailed::pad8(m_chunk.size()));
+
+        replay_index_entry entry;
+        entry.first_frame = m_chunk_first;
+        entry.offset = m_written;
+        m_index.push_back(entry);
+        m_written += m_chunk.size();
+
+        m_front.insert(m_front.end(), m_chunk.begin(), m_chunk.end());
+        m_chunk.clear();
+        if(m_front.size() >= buffer_size)
+            hand_over();
+    }
+
+    void replay_recorder::hand_over()
+    {
+        std::unique_lock lock(m_mutex);
+        // Only waits if the disk can't keep up with a whole buffer of frames
+        m_cv.wait(lock, [this] { return m_back.empty(); });
+        m_front.swap(m_back);
+        m_cv.notify_all();
+    }
+
+    void replay_recorder::write_main(std::stop_token stop)
+    {
+        std::unique_lock lock(m_mutex);
+        for(;;)
+        {
+            if(!m_cv.wait(lock, stop, [this] { return !m_back.empty(); }))
+                return;
+
+            // record() doesn't touch the back buffer until it is empty again
+            lock.unlock();
+            if(!m_failed)
+            {
+                m_ofs.write(reinterpret_cast<const char*>(m_back.data()), m_back.size());
+                if(!m_ofs)
+                    m_failed = true;
+            }
+            lock.lock();
+
+            m_back.clear();
+            m_cv.notify_all();
+        }
+    }
+
+    replay_file::replay_file(const std::filesystem::path& path)
+    {
+        namespace bip = boost::interprocess;
+        try
+        {
+            m_file = bip::file_mapping(path.string().c_str(), bip::read_only);
+            m_region = bip::mapped_region(m_file, bip::read_only);
+        }
+        catch(const bip::interprocess_exception&)
+        {
+            throw std::runtime_error("failed to open " + path.string());
+        }
+
+        auto data = bytes();
+        if(data.size() < sizeof(replay_header))
+            throw std::runtime_error(path.string() + " is not a replay");
+        replay_header header;
+        std::memcpy(&header, data.data(), sizeof(header));
+        auto meta = detailed::parse_header(header, path);
+        m_info = meta.info;
+        m_date = meta.date;
+
+        if(data.size() >= sizeof(replay_header) + sizeof(replay_footer))
+        {
+            auto* footer = reinterpret_cast<const replay_footer*>(data.data() + data.size() - sizeof(replay_footer));
+            const std::uint64_t index_end = data.size() - sizeof(replay_footer);
+            if(
+                std::equal(std::begin(footer->magic), std::end(footer->magic), detailed::replay_index_magic) &&
+                footer->index_offset >= sizeof(replay_header) &&
+                footer->index_offset <= index_end &&
+                footer->chunk_count == (index_end - footer->index_offset) / sizeof(replay_index_entry)
+            ) {
+                m_index = {
+                    reinterpret_cast<const replay_index_entry*>(data.data() + footer->index_offset),
+                    static_cast<std::size_t>(footer->chunk_count)
+                };
+                m_frames = footer->frames;
+                // Only patched after the footer is written
+                if(meta.complete && meta.frames == m_frames)
+                    m_checksum = meta.checksum;
+                return;
+            }
+        }
+        scan_chunks();
+    }
+
+    replay_file::chunk_view replay_file::chunk(std::size_t i) const
+    {
+        auto data = bytes();
+        const std::uint64_t offset = m_index[i].offset;
+        if(offset > data.size() || data.size() - offset < sizeof(replay_chunk_header))
+            throw std::runtime_error("damaged replay chunk");
+        auto* header = reinterpret_cast<const replay_chunk_header*>(data.data() + offset);
+        const std::uint64_t state_size = header->state_size;
+        const std::uint64_t input_size = header->input_size;
+        const std::uint64_t available = data.size() - offset - sizeof(replay_chunk_header);
+        if(
+            !std::equal(std::begin(header->tag), std::end(header->tag), detailed::replay_chunk_tag) ||
+            header->frames > replay_recorder::max_chunk_frames ||
+            state_size > available ||
+            detailed::pad8(state_size) > available ||
+            input_size > available - detailed::pad8(state_size)
+        ) {
+            throw std::runtime_error("damaged replay chunk");
+        }
+
+        auto* state = data.data() + offset + sizeof(replay_chunk_header);
+        auto* inputs = state + detailed::pad8(state_size);
+        return {
+            header->first_frame,
+            header->frames,
+            { state, static_cast<std::size_t>(state_size) },
+            { inputs, static_cast<std::size_t>(input_size) },
+            static_cast<replay_encoding>(static_cast<std::uint32_t>(header->encoding))
+        };
+    }
+
+    std::size_t replay_file::find_chunk(std::uint64_t frame) const noexcept
+    {
+        auto it = std::upper_bound(
+            m_index.begin(),
+            m_index.end(),
+            frame,
+            [](std::uint64_t f, const replay_index_entry& e) { return f < e.first_frame; }
+        );
+        return it == m_index.begin() ? 0 : static_cast<std::size_t>(std::prev(it) - m_index.begin());
+    }
+
+    void replay_file::read_inputs(std::size_t i, std::vector<frame_input>& out) const
+    {
+        auto c = chunk(i);
+        out.clear();
+        decode_inputs(c.inputs, c.encoding, m_info.players, c.frames, out);
+    }
+
+    std::optional<std::pair<std::uint64_t, std::span<const std::byte>>> replay_file::find_keyframe(std::uint64_t frame) const
+    {
+        if(m_index.empty())
+            return std::nullopt;
+        for(std::size_t i = find_chunk(frame) + 1; i-- > 0;)
+        {
+            try
+            {
+                auto c = chunk(i);
+                if(!c.state.empty() && c.first_frame <= frame)
+                    return std::make_pair(c.first_frame, c.state);
+            }
+            catch(const std::runtime_error&) {}
+        }
+        return std::nullopt;
+    }
+
+    std::span<const std::byte> replay_file::bytes() const noexcept
+    {
+        return { static_cast<const std::byte*>(m_region.get_address()), m_region.get_size() };
+    }
+
+    void replay_file::scan_chunks()
+    {
+        m_recovered = true;
+        auto data = bytes();
+        std::uint64_t offset = sizeof(replay_header);
+        while(offset <= data.size() && data.size() - offset >= sizeof(replay_chunk_header))
+        {
+            replay_index_entry entry;
+            entry.offset = offset;
+            m_scanned.push_back(entry);
+            m_index = m_scanned;
+
+            // A chunk cut short ends the recording
+            chunk_view c;
+            try
+            {
+                c = chunk(m_scanned.size() - 1);
+            }
+            catch(const std::runtime_error&)
+            {
+                m_scanned.pop_back();
+                break;
+            }
+            m_scanned.back().first_frame = c.first_frame;
+            m_frames = c.first_frame + c.frames;
+            offset = detailed::pad8(static_cast<std::uint64_t>(c.inputs.data() + c.inputs.size() - data.data()));
+        }
+        m_index = m_scanned;
+    }
+
+    replay_metadata read_replay_metadata(const std::filesystem::path& path)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        if(!ifs)
+            throw std::runtime_error("failed to open " + path.string());
+        replay_header header;
+        if(!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)))
+            throw std::runtime_error(path.string() + " is not a replay");
+        return detailed::parse_header(header, path);
+    }
+
+    std::filesystem::path replay_directory()
+    {
+        return "replays";
+    }
+
+    std::filesystem::path make_replay_path(unsigned int seed, int local_player)
+    {
+        std::filesystem::create_directories(replay_directory());
+
+        char date[32] = "";
+        std::time_t now = std::time(nullptr);
+        if(auto* tm = std::localtime(&now))
+            std::strftime(date, sizeof(date), "%Y%m%d-%H%M%S", tm);
+        return replay_directory() / (
+            std::string(date) +
+            "_" +
+            std::to_string(seed) +
+            "_" +
+            std::to_string(local_player + 1) +
+            "P.awr"
+        );
+    }
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/endian/arithmetic.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "game.hpp"
+#include "replay_codec.hpp"
+
+
+namespace awe
+{
+    // What the world of a replay is created from
+    struct replay_info
+    {
+        unsigned int seed = 0;
+        std::uint32_t players = max_players;
+        // Spawned before the first frame
+        std::uint64_t entities = 0;
+    };
+
+    // What the replay list shows, read from the header alone
+    struct replay_metadata
+    {
+        replay_info info;
+        // Seconds since the Unix epoch when the recording started
+        std::int64_t date = 0;
+        std::uint64_t frames = 0;
+        std::optional<std::uint64_t> checksum; // after the last frame
+        // The recording was closed, otherwise frames is 0 and the chunks have to be scanned
+        bool complete = false;
+    };
+
+    //  Layout of a replay file, little-endian byte by byte so every part can
+    //  be read in place from a memory mapping:
+    //    replay_header
+    //    chunks, each a replay_chunk_header, the state before its first frame
+    //      if it is a keyframe and the inputs of its frames encoded as in
+    //      replay_encoding, both padded to 8 bytes
+    //    the index, one replay_index_entry per chunk
+    //    replay_footer
+    //  A recording cut short has no index, the chunks are scanned instead.
+    struct replay_header
+    {
+        enum flag : std::uint32_t
+        {
+            COMPLETE = 1,
+            HAS_CHECKSUM = 2
+        };
+
+        char magic[8];
+        boost::endian::little_uint32_t version;
+        boost::endian::little_uint32_t seed;
+        boost::endian::little_uint32_t players;
+        boost::endian::little_uint32_t flags;
+        boost::endian::little_uint64_t entities;
+        boost::endian::little_int64_t date;
+        // Patched when the recording is closed
+        boost::endian::little_uint64_t frames;
+        boost::endian::little_uint64_t checksum;
+        boost::endian::little_uint64_t reserved;
+    };
+    static_assert(sizeof(replay_header) == 64);
+
+    struct replay_chunk_header
+    {
+        char tag[4];
+        boost::endian::little_uint32_t frames;
+        boost::endian::little_uint64_t first_frame;
+        boost::endian::little_uint64_t state_size; // 0 if the chunk has no keyframe
+        boost::endian::little_uint32_t input_size;
+        boost::endian::little_uint32_t encoding; // replay_encoding
+    };
+    static_assert(sizeof(replay_chunk_header) == 32);
+
+    struct replay_index_entry
+    {
+        boost::endian::little_uint64_t first_frame;
+        boost::endian::little_uint64_t offset;
+    };
+    static_assert(sizeof(replay_index_entry) == 16);
+
+    struct replay_footer
+    {
+        boost::endian::little_uint64_t chunk_count;
+        boost::endian::little_uint64_t index_offset;
+        boost::endian::little_uint64_t frames;
+        char magic[8];
+    };
+    static_assert(sizeof(replay_footer) == 32);
+
+    //  Records a replay file chunk by chunk. A chunk holds up to
+    //  keyframe_interval frames and starts with the state before its first
+    //  frame, so seeking resimulates at most one chunk.
+    //  The inputs are run-length encoded as they are recorded, the LZ pass
+    //  runs once per chunk and is kept if it makes the chunk smaller.
+    //  The simulation only copies into buffers. Full buffers are swapped
+    //  with a second one that a background thread writes to disk.
+    class replay_recorder
+    {
+    public:
+        // Chunks are handed to the writer in buffers of about this size
+        static constexpr std::size_t buffer_size = 64 * 1024;
+        static constexpr std::uint64_t default_keyframe_interval = 600;
+        // Longer intervals are shortened to this
+        static constexpr std::uint64_t max_chunk_frames = 1 << 20;
+
+        // Throws std::runtime_error if the file can't be created
+        replay_recorder(
+            const std::filesystem::path& path,
+            const replay_info& info,
+            std::uint64_t keyframe_interval = default_keyframe_interval,
+            replay_encoding encoding = replay_encoding::packed_rle_lz
+        );
+        ~replay_recorder();
+
+        void record(const frame_input& input);
+        // The state before the next frame is due
+        bool wants_keyframe() const noexcept
+        {
+            return m_frames > 0 && m_frames % m_keyframe_interval == 0 && m_frames != m_last_keyframe;
+        }
+        // state is the state before the next frame, which starts a new chunk
+        void record_keyframe(std::span<const std::byte> state);
+        // Checksum of the state after the last recorded frame,
+        // stored in the header to check the playback against
+        void set_checksum(std::uint64_t checksum) noexcept { m_checksum = checksum; }
+        // Writes the remaining frames and the index, stops the writer
+        // and patches the header with the length and the checksum
+        void close();
+
+        const replay_info& info() const noexcept { return m_info; }
+        std::uint64_t frames() const noexcept { return m_frames; }
+        // A write has failed, the frames after it are dropped
+        bool failed() const noexcept { return m_failed; }
+
+    private:
+        replay_info m_info;
+        std::int64_t m_date;
+        std::uint64_t m_keyframe_interval;
+        replay_encoding m_encoding;
+        std::ofstream m_ofs;
+        std::uint64_t m_frames = 0;
+        std::uint64_t m_last_keyframe = 0;
+        std::optional<std::uint64_t> m_checksum;
+        bool m_closed = false;
+        std::atomic_bool m_failed = false;
+
+        // Chunk being filled and its first frame
+        std::vector<std::byte> m_chunk;
+        std::uint64_t m_chunk_first = 0;
+        input_encoder m_encoder{ m_chunk, m_info.players };
+        std::vector<std::byte> m_lz;
+        std::uint64_t m_written = 0; // bytes handed to the writer
+        std::vector<replay_index_entry> m_index;
+
+        std::vector<std::byte> m_front; // complete chunks
+        std::mutex m_mutex;
+        std::condition_variable_any m_cv;
+        std::vector<std::byte> m_back; // written while not empty
+        std::jthread m_writer;
+
+        void write_header(bool complete);
+        void begin_chunk(std::span<const std::byte> state);
+        void end_chunk();
+        // Waits until the writer is done with the back buffer
+        void hand_over();
+        void write_main(std::stop_token stop);
+    };
+
+    //  Read-only memory mapping of a replay file.
+    //  Opening reads the header and the index only, a chunk is read when it
+    //  is played, so a long replay opens at once.
+    class replay_file
+    {
+    public:
+        struct chunk_view
+        {
+            std::uint64_t first_frame;
+            std::uint32_t frames;
+            std::span<const std::byte> state; // empty if not a keyframe
+            std::span<const std::byte> inputs;
+            replay_encoding encoding;
+        };
+
+        // Throws std::runtime_error if the file can't be mapped or isn't a replay
+        explicit replay_file(const std::filesystem::path& path);
+
+        const replay_info& info() const noexcept { return m_info; }
+        std::int64_t date() const noexcept { return m_date; }
+        std::uint64_t frames() const noexcept { return m_frames; }
+        // The footer was missing and the chunks were scanned
+        bool recovered() const noexcept { return m_recovered; }
+        // Checksum after the last frame, std::nullopt if it wasn't recorded
+        std::optional<std::uint64_t> checksum() const noexcept { return m_checksum; }
+
+        std::size_t chunk_count() const noexcept { return m_index.size(); }
+        // Throws std::runtime_error if the chunk is damaged
+        chunk_view chunk(std::size_t i) const;
+        // Chunk containing frame, the last one past the end
+        std::size_t find_chunk(std::uint64_t frame) const noexcept;
+        // Decodes the inputs of a chunk into out.
+        // Throws std::runtime_error if the chunk is damaged.
+        void read_inputs(std::size_t i, std::vector<frame_input>& out) const;
+
+        // Closest state at or before frame, std::nullopt before the first one.
+        // Damaged chunks are skipped, the state itself is not checked.
+        std::optional<std::pair<std::uint64_t, std::span<const std::byte>>> find_keyframe(std::uint64_t frame) const;
+
+    private:
+        boost::interprocess::file_mapping m_file;
+        boost::interprocess::mapped_region m_region;
+        replay_info m_info;
+        std::int64_t m_date = 0;
+        std::uint64_t m_frames = 0;
+        std::optional<std::uint64_t> m_checksum;
+        std::span<const replay_index_entry> m_index;
+        std::vector<replay_index_entry> m_scanned;
+        bool m_recovered = false;
+
+        std::span<const std::byte> bytes() const noexcept;
+        void scan_chunks();
+    };
+
+    // Reads the header only.
+    // Throws std::runtime_error if the file can't be read or isn't a replay.
+    replay_metadata read_replay_metadata(const std::filesystem::path& path);
+
+    // Directory the games are recorded to
+    std::filesystem::path replay_directory();
+    // "<date>-<time>_<seed>_<n>P.awr" in the replay directory, which is created if needed
+    std::filesystem::path make_replay_path(unsigned int seed, int local_player);
+}
@@ -0,0 +1,238 @@
+#include "replay_codec.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        void write_varint(std::vector<std::byte>& out, std::uint64_t val)
+        {
+            while(val >= 0x80)
+            {
+                out.push_back(static_cast<std::byte>(val | 0x80));
+                val >>= 7;
+            }
+            out.push_back(static_cast<std::byte>(val));
+        }
+
+        std::uint64_t read_varint(std::span<const std::byte> in, std::size_t& pos)
+        {
+            std::uint64_t val = 0;
+            for(unsigned int shift = 0; shift < 64; shift += 7)
+            {
+                if(pos >= in.size())
+                    throw std::runtime_error("damaged replay inputs");
+                auto b = static_cast<std::uint64_t>(in[pos++]);
+                val |= (b & 0x7F) << shift;
+                if(!(b & 0x80))
+                    return val;
+            }
+            throw std::runtime_error("damaged replay inputs");
+        }
+
+        // Length above what fits in a nibble of the LZ token, as 255s and a remainder
+        void write_lz_length(std::vector<std::byte>& out, std::size_t len)
+        {
+            for(; len >= 255; len -= 255)
+                out.push_back(std::byte(255));
+            out.push_back(static_cast<std::byte>(len));
+        }
+
+        std::size_t read_lz_length(std::span<const std::byte> in, std::size_t& pos)
+        {
+            std::size_t len = 0;
+            for(;;)
+            {
+                if(pos >= in.size())
+                    throw std::runtime_error("damaged replay inputs");
+                auto b = static_cast<std::size_t>(in[pos++]);
+                len += b;
+                if(b != 255)
+                    return len;
+            }
+        }
+
+        void write_lz_sequence(
+            std::vector<std::byte>& out,
+            std::span<const std::byte> literals,
+            std::size_t offset,
+            std::size_t match
+        ) {
+            constexpr std::size_t min_match = 4;
+            std::size_t lit = literals.size();
+            std::size_t extra = match > 0 ? match - min_match : 0;
+            out.push_back(static_cast<std::byte>((std::min<std::size_t>(lit, 15) << 4) | std::min<std::size_t>(extra, 15)));
+            if(lit >= 15)
+                write_lz_length(out, lit - 15);
+            out.insert(out.end(), literals.begin(), literals.end());
+            if(match == 0)
+                return;
+            out.push_back(static_cast<std::byte>(offset & 0xFF));
+            out.push_back(static_cast<std::byte>(offset >> 8));
+            if(extra >= 15)
+                write_lz_length(out, extra - 15);
+        }
+    }
+
+    void input_encoder::flush()
+    {
+        if(m_run == 0)
+            return;
+        m_out.push_back(static_cast<std::byte>(m_packed));
+        detailed::write_varint(m_out, m_run - 1);
+        m_run = 0;
+    }
+
+    void decode_inputs(
+        std::span<const std::byte> data,
+        replay_encoding encoding,
+        std::uint32_t players,
+        std::uint64_t frames,
+        std::vector<frame_input>& out
+    ) {
+        if(players == 0 || players > max_players)
+            throw std::runtime_error("damaged replay inputs");
+        out.reserve(out.size() + frames);
+
+        switch(encoding)
+        {
+        case replay_encoding::raw:
+            if(data.size() / players < frames)
+                throw std::runtime_error("damaged replay inputs");
+            for(std::uint64_t f = 0; f < frames; ++f)
+            {
+                frame_input input;
+                std::memcpy(input.keys.data(), data.data() + f * players, players);
+                out.push_back(input);
+            }
+            return;
+
+        case replay_encoding::packed_rle_lz:
+            {
+                std::vector<std::byte> rle;
+                lz_decompress(data, rle);
+                decode_inputs(rle, replay_encoding::packed_rle, players, frames, out);
+            }
+            return;
+
+        case replay_encoding::packed_rle:
+            break;
+
+        default:
+            throw std::runtime_error("unknown replay input encoding");
+        }
+
+        constexpr unsigned int used = (1u << input_mask_bits) - 1;
+        std::size_t pos = 0;
+        for(std::uint64_t left = frames; left > 0;)
+        {
+            if(pos >= data.size())
+                throw std::runtime_error("damaged replay inputs");
+            auto packed = static_cast<unsigned int>(data[pos++]);
+            std::uint64_t run = detailed::read_varint(data, pos);
+            if(run >= left)
+                throw std::runtime_error("damaged replay inputs");
+
+            frame_input input;
+            for(std::uint32_t i = 0; i < players; ++i)
+                input.keys[i] = static_cast<input_mask>((packed >> (i * input_mask_bits)) & used);
+            out.insert(out.end(), run + 1, input);
+            left -= run + 1;
+        }
+    }
+
+    void lz_compress(std::span<const std::byte> in, std::vector<std::byte>& out)
+    {
+        constexpr std::size_t min_match = 4;
+        constexpr std::size_t max_offset = 0xFFFF;
+        constexpr unsigned int hash_bits = 12;
+        constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+        if(in.size() >= none)
+            throw std::length_error("too large to compress");
+
+        detailed::write_varint(out, in.size());
+
+        auto load32 = [&](std::size_t pos)
+        {
+            std::uint32_t val;
+            std::memcpy(&val, in.data() + pos, sizeof(val));
+            return val;
+        };
+        std::array<std::uint32_t, 1u << hash_bits> table;
+        table.fill(none);
+
+        std::size_t anchor = 0;
+        std::size_t pos = 0;
+        while(pos + min_match <= in.size())
+        {
+            std::uint32_t seq = load32(pos);
+            std::uint32_t& slot = table[(seq * 2654435761u) >> (32 - hash_bits)];
+            std::uint32_t candidate = slot;
+            slot = static_cast<std::uint32_t>(pos);
+            if(candidate == none || pos - candidate > max_offset || load32(candidate) != seq)
+            {
+                ++pos;
+                continue;
+            }
+
+            std::size_t len = min_match;
+            while(pos + len < in.size() && in[candidate + len] == in[pos + len])
+                ++len;
+            detailed::write_lz_sequence(out, in.subspan(anchor, pos - anchor), pos - candidate, len);
+            pos += len;
+            anchor = pos;
+        }
+        if(anchor < in.size())
+            detailed::write_lz_sequence(out, in.subspan(anchor), 0, 0);
+    }
+
+    void lz_decompress(std::span<const std::byte> in, std::vector<std::byte>& out)
+    {
+        std::size_t pos = 0;
+        const std::uint64_t size = detailed::read_varint(in, pos);
+        // No input byte expands to more than 255 output bytes
+        if(size / 255 > in.size())
+            throw std::runtime_error("damaged replay inputs");
+
+        const std::size_t base = out.size();
+        out.reserve(base + size);
+        while(out.size() - base < size)
+        {
+            if(pos >= in.size())
+                throw std::runtime_error("damaged replay inputs");
+            auto token = static_cast<std::size_t>(in[pos++]);
+
+            std::size_t lit = token >> 4;
+            if(lit == 15)
+                lit += detailed::read_lz_length(in, pos);
+            if(lit > in.size() - pos || lit > size - (out.size() - base))
+                throw std::runtime_error("damaged replay inputs");
+            out.insert(out.end(), in.begin() + pos, in.begin() + pos + lit);
+            pos += lit;
+            if(out.size() - base == size)
+                break;
+
+            if(in.size() - pos < 2)
+                throw std::runtime_error("damaged replay inputs");
+            std::size_t offset =
+                static_cast<std::size_t>(in[pos]) |
+                static_cast<std::size_t>(in[pos + 1]) << 8;
+            pos += 2;
+            std::size_t match = (token & 15) + 4;
+            if((token & 15) == 15)
+                match += detailed::read_lz_length(in, pos);
+            if(offset == 0 || offset > out.size() - base || match > size - (out.size() - base))
+                throw std::runtime_error("damaged replay inputs");
+
+            // The match may overlap the bytes it produces
+            std::size_t from = out.size() - offset;
+            for(std::size_t i = 0; i < match; ++i)
+                out.push_back(out[from + i]);
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "game.hpp"
+
+
+namespace awe
+{
+    // How the inputs of a replay chunk are stored
+    enum class replay_encoding : std::uint32_t
+    {
+        // One input_mask per player and frame
+        raw = 0,
+        // Runs of equal frames, see input_encoder
+        packed_rle = 1,
+        // packed_rle compressed by lz_compress
+        packed_rle_lz = 2
+    };
+
+    // Bits of an input_mask that are used, one per cmd::move_direction
+    constexpr unsigned int input_mask_bits = 4;
+    static_assert(cmd::MV_RIGHT < input_mask_bits);
+    static_assert(max_players * input_mask_bits <= 8, "a packed frame has to fit in a byte");
+
+    //  Streams frames as runs of equal frames. A run is the masks of every
+    //  player packed into one byte, followed by the number of repeats as a
+    //  LEB128 varint. Held keys take two bytes for the whole time they are held.
+    class input_encoder
+    {
+    public:
+        input_encoder(std::vector<std::byte>& out, std::uint32_t players) noexcept
+            : m_out(out), m_players(players) {}
+
+        void add(const frame_input& input)
+        {
+            std::uint8_t packed = pack(input);
+            if(m_run > 0 && packed == m_packed)
+            {
+                ++m_run;
+                return;
+            }
+            flush();
+            m_packed = packed;
+            m_run = 1;
+        }
+        // Writes the pending run, the next frame starts a new one
+        void flush();
+
+    private:
+        std::vector<std::byte>& m_out;
+        std::uint32_t m_players;
+        std::uint8_t m_packed = 0;
+        std::uint64_t m_run = 0;
+
+        std::uint8_t pack(const frame_input& input) const noexcept
+        {
+            constexpr unsigned int used = (1u << input_mask_bits) - 1;
+            unsigned int packed = 0;
+            for(std::uint32_t i = 0; i < m_players; ++i)
+                packed |= (input.keys[i] & used) << (i * input_mask_bits);
+            return static_cast<std::uint8_t>(packed);
+        }
+    };
+
+    // Appends exactly frames frames to out.
+    // Throws std::runtime_error if data doesn't hold them.
+    void decode_inputs(
+        std::span<const std::byte> data,
+        replay_encoding encoding,
+        std::uint32_t players,
+        std::uint64_t frames,
+        std::vector<frame_input>& out
+    );
+
+    //  Byte-oriented LZ77 in the style of LZ4: sequences of literals and a
+    //  match of at least 4 bytes within the last 64 KiB, found greedily
+    //  through a hash table. Meant for the small repeating patterns left
+    //  after run-length encoding, decoding is a few copies per sequence.
+    void lz_compress(std::span<const std::byte> in, std::vector<std::byte>& out);
+    // Appends the decompressed bytes to out.
+    // Throws std::runtime_error if in is damaged.
+    void lz_decompress(std::span<const std::byte> in, std::vector<std::byte>& out);
+}
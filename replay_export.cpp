@@ -0,0 +1,137 @@
+#include "replay_export.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <SDL.h>
+#include <stb_image_write.h>
+#include "atlas.hpp"
+#include "runner.hpp"
+#include "thread_pool.hpp"
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        std::filesystem::path export_path(const std::filesystem::path& dir, std::uint64_t n)
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "frame_%06llu.png", static_cast<unsigned long long>(n));
+            return dir / name;
+        }
+    }
+
+    export_stats export_replay(replay_file file, const export_options& opts)
+    {
+        if(opts.size <= 0 || opts.every == 0)
+            throw std::invalid_argument("invalid export size or step");
+        std::filesystem::create_directories(opts.directory);
+
+        export_stats stats;
+        stats.threads = opts.threads > 0 ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+        thread_pool pool(stats.threads);
+
+        replay_runner rr(std::move(file));
+        const std::uint64_t last = std::min(opts.last, rr.frames());
+        if(opts.first > last)
+            throw std::invalid_argument("the first exported frame is past the end of the replay");
+
+        std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)> surface(
+            SDL_CreateRGBSurfaceWithFormat(0, opts.size, opts.size, 32, SDL_PIXELFORMAT_RGBA32),
+            &SDL_FreeSurface
+        );
+        if(!surface)
+            throw std::runtime_error(std::string("failed to create the export surface: ") + SDL_GetError());
+        std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> ren(
+            SDL_CreateSoftwareRenderer(surface.get()),
+            &SDL_DestroyRenderer
+        );
+        if(!ren)
+            throw std::runtime_error(std::string("failed to create the export renderer: ") + SDL_GetError());
+        std::optional<texture_atlas> atlas;
+        if(!opts.sprites.empty())
+            atlas.emplace(ren.get(), load_atlas_image(opts.sprites, atlas_cache_directory(opts.sprites)));
+
+        struct batch
+        {
+            std::uint64_t first_image = 0;
+            std::size_t count = 0;
+            std::vector<std::vector<unsigned char>> pixels;
+        };
+        // Rendered into while the other one is encoded,
+        // two images per thread keep every encoder busy
+        std::array<batch, 2> batches;
+        const std::size_t batch_size = pool.size() * 2;
+        const int pitch = opts.size * 4;
+        for(auto& b : batches)
+            b.pixels.assign(batch_size, std::vector<unsigned char>(static_cast<std::size_t>(pitch) * opts.size));
+
+        std::atomic_bool failed = false;
+        std::jthread encoder;
+        auto encode = [&](batch& b)
+        {
+            // Assigning joins the encoder of the other batch
+            encoder = std::jthread([&pool, &b, &opts, &failed, pitch] {
+                pool.parallel_for(b.count, [&](std::size_t i) {
+                    auto path = detailed::export_path(opts.directory, b.first_image + i);
+                    if(!stbi_write_png(path.string().c_str(), opts.size, opts.size, 4, b.pixels[i].data(), pitch))
+                        failed = true;
+                });
+            });
+        };
+
+        using clock = std::chrono::steady_clock;
+        auto start = clock::now();
+        clock::duration render_time{};
+
+        std::size_t current = 0;
+        for(std::uint64_t frame = opts.first; frame <= last && !failed; frame += opts.every)
+        {
+            auto render_start = clock::now();
+            rr.go_to(frame);
+            if(rr.failed())
+                throw std::runtime_error(rr.error());
+            if(rr.frame() != frame)
+                throw std::runtime_error("failed to play the replay up to frame " + std::to_string(frame));
+
+            batch& b = batches[current];
+            if(b.count == 0)
+                b.first_image = stats.images;
+            rr.publish();
+            SDL_SetRenderDrawColor(ren.get(), 0, 0, 0, 255);
+            SDL_RenderClear(ren.get());
+            // The exact state of the frame, nothing to interpolate from
+            rr.render(ren.get(), atlas ? &*atlas : nullptr, 1.0f);
+            if(SDL_RenderReadPixels(ren.get(), nullptr, SDL_PIXELFORMAT_RGBA32, b.pixels[b.count].data(), pitch) != 0)
+                throw std::runtime_error(std::string("failed to read the rendered frame: ") + SDL_GetError());
+            ++b.count;
+            ++stats.images;
+            render_time += clock::now() - render_start;
+
+            if(b.count == batch_size)
+            {
+                encode(b);
+                current ^= 1;
+                batches[current].count = 0;
+            }
+        }
+        if(batches[current].count > 0)
+            encode(batches[current]);
+        if(encoder.joinable())
+            encoder.join();
+        if(failed)
+            throw std::runtime_error("failed to write the images to " + opts.directory.string());
+
+        stats.seconds = std::chrono::duration<double>(clock::now() - start).count();
+        stats.render_seconds = std::chrono::duration<double>(render_time).count();
+        return stats;
+    }
+}
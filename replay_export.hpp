@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include "replay.hpp"
+
+
+namespace awe
+{
+    struct export_options
+    {
+        std::filesystem::path directory;
+        // Width and height of the images in pixels
+        int size = 512;
+        // States exported, after first to last frames in steps of every
+        std::uint64_t first = 0;
+        std::uint64_t last = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t every = 1;
+        // Encoding threads, the hardware concurrency if 0
+        unsigned int threads = 0;
+        // Drawn with solid quads if empty or without sprites
+        std::filesystem::path sprites;
+    };
+
+    struct export_stats
+    {
+        std::uint64_t images = 0;
+        unsigned int threads = 0;
+        double seconds = 0.0;
+        // Spent simulating and rendering, the rest of the time waited for the encoders
+        double render_seconds = 0.0;
+    };
+
+    //  Plays a replay and writes the selected states as "frame_<n>.png",
+    //  numbered from 0 without gaps.
+    //  The frames are drawn by the software renderer into a surface, so no
+    //  window or GPU is needed. Batches of rendered frames are encoded on a
+    //  thread pool while the next batch is rendered.
+    //  Throws std::runtime_error if a frame can't be rendered or written.
+    export_stats export_replay(replay_file file, const export_options& opts);
+}
@@ -0,0 +1,191 @@
+#include "replay_library.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include "state.hpp"
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        constexpr char library_magic[8] = { 'A', 'W', 'E', 'L', 'I', 'B', 'R', 'Y' };
+        // Bumped with the replay version, the metadata is re-read then
+        constexpr std::uint32_t library_version = 1;
+
+        struct library_record
+        {
+            std::uint64_t size = 0;
+            std::int64_t mtime = 0;
+            replay_metadata meta;
+        };
+
+        std::int64_t to_index_time(std::filesystem::file_time_type t)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        }
+
+        // Empty if the file is missing or damaged
+        std::unordered_map<std::string, library_record> load_library_index(const std::filesystem::path& path)
+        {
+            std::unordered_map<std::string, library_record> records;
+            std::ifstream ifs(path, std::ios::binary);
+            if(!ifs)
+                return records;
+            state_buffer buf;
+            std::transform(
+                std::istreambuf_iterator<char>(ifs),
+                std::istreambuf_iterator<char>(),
+                std::back_inserter(buf),
+                [](char c) { return static_cast<std::byte>(c); }
+            );
+
+            try
+            {
+                state_reader r(buf);
+                char magic[8];
+                r.read_bytes(magic, sizeof(magic));
+                if(!std::equal(std::begin(magic), std::end(magic), library_magic))
+                    return {};
+                if(r.read<std::uint32_t>() != library_version)
+                    return {};
+                auto count = r.read<std::uint64_t>();
+                for(std::uint64_t i = 0; i < count; ++i)
+                {
+                    auto name_size = r.read<std::uint32_t>();
+                    if(name_size > r.remaining())
+                        return {};
+                    std::string name(name_size, '\0');
+                    r.read_bytes(name.data(), name.size());
+                    library_record rec;
+                    rec.size = r.read<std::uint64_t>();
+                    rec.mtime = r.read<std::int64_t>();
+                    rec.meta.info.seed = r.read<std::uint32_t>();
+                    rec.meta.info.players = r.read<std::uint32_t>();
+                    rec.meta.info.entities = r.read<std::uint64_t>();
+                    rec.meta.date = r.read<std::int64_t>();
+                    rec.meta.frames = r.read<std::uint64_t>();
+                    rec.meta.complete = r.read<std::uint8_t>() != 0;
+                    bool has_checksum = r.read<std::uint8_t>() != 0;
+                    auto checksum = r.read<std::uint64_t>();
+                    if(has_checksum)
+                        rec.meta.checksum = checksum;
+                    records.emplace(std::move(name), std::move(rec));
+                }
+            }
+            catch(const std::out_of_range&)
+            {
+                return {};
+            }
+
+            return records;
+        }
+
+        // Written to a temporary file first like the save states,
+        // a directory that can't be written to is listed without an index
+        void save_library_index(
+            const std::filesystem::path& path,
+            const std::unordered_map<std::string, library_record>& records
+        ) {
+            state_buffer buf;
+            state_writer w(buf);
+            w.write_bytes(library_magic, sizeof(library_magic));
+            w.write<std::uint32_t>(library_version);
+            w.write<std::uint64_t>(records.size());
+            for(auto& [name, rec] : records)
+            {
+                w.write<std::uint32_t>(static_cast<std::uint32_t>(name.size()));
+                w.write_bytes(name.data(), name.size());
+                w.write<std::uint64_t>(rec.size);
+                w.write<std::int64_t>(rec.mtime);
+                w.write<std::uint32_t>(rec.meta.info.seed);
+                w.write<std::uint32_t>(rec.meta.info.players);
+                w.write<std::uint64_t>(rec.meta.info.entities);
+                w.write<std::int64_t>(rec.meta.date);
+                w.write<std::uint64_t>(rec.meta.frames);
+                w.write<std::uint8_t>(rec.meta.complete);
+                w.write<std::uint8_t>(rec.meta.checksum.has_value());
+                w.write<std::uint64_t>(rec.meta.checksum.value_or(0));
+            }
+
+            std::filesystem::path tmp = path;
+            tmp += ".tmp";
+            {
+                std::ofstream ofs(tmp, std::ios::binary);
+                ofs.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+                if(!ofs)
+                    return;
+            }
+            std::error_code ec;
+            std::filesystem::rename(tmp, path, ec);
+        }
+    }
+
+    void replay_library::refresh(const std::filesystem::path& dir)
+    {
+        m_dir = dir;
+        m_entries.clear();
+        m_headers_read = 0;
+
+        const auto index_path = dir / index_name;
+        auto cached = detailed::load_library_index(index_path);
+        std::unordered_map<std::string, detailed::library_record> records;
+        std::error_code ec;
+        for(auto& de : std::filesystem::directory_iterator(dir, ec))
+        {
+            if(de.path().extension() != ".awr" || !de.is_regular_file(ec))
+                continue;
+            const auto size = de.file_size(ec);
+            if(ec)
+                continue;
+            const auto mtime = de.last_write_time(ec);
+            if(ec)
+                continue;
+
+            detailed::library_record rec;
+            rec.size = size;
+            rec.mtime = detailed::to_index_time(mtime);
+            std::string name = de.path().filename().string();
+            if(auto it = cached.find(name); it != cached.end() && it->second.size == rec.size && it->second.mtime == rec.mtime)
+                rec.meta = it->second.meta;
+            else
+            {
+                try
+                {
+                    rec.meta = read_replay_metadata(de.path());
+                    ++m_headers_read;
+                }
+                catch(const std::runtime_error&)
+                {
+                    continue;
+                }
+            }
+
+            m_entries.push_back({ de.path(), rec.size, rec.meta });
+            records.emplace(std::move(name), std::move(rec));
+        }
+
+        if(m_headers_read > 0 || records.size() != cached.size())
+            detailed::save_library_index(index_path, records);
+
+        std::sort(m_entries.begin(), m_entries.end(), [](const entry& lhs, const entry& rhs) {
+            if(lhs.meta.date != rhs.meta.date)
+                return lhs.meta.date > rhs.meta.date;
+            return lhs.path > rhs.path;
+        });
+    }
+
+    std::string format_replay_date(std::int64_t date)
+    {
+        char buf[32] = "";
+        std::time_t t = static_cast<std::time_t>(date);
+        if(auto* tm = std::localtime(&t))
+            std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", tm);
+        return buf;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "replay.hpp"
+
+
+namespace awe
+{
+    //  The replays of a directory with their metadata.
+    //  The metadata is kept in an index file in the directory, keyed by file
+    //  name, size and modification time. A refresh only reads the header of
+    //  the replays that are new or changed since the last one, the others
+    //  cost a directory entry each.
+    class replay_library
+    {
+    public:
+        static constexpr std::string_view index_name = "index.cache";
+
+        struct entry
+        {
+            std::filesystem::path path;
+            std::uint64_t size = 0;
+            replay_metadata meta;
+        };
+
+        // Lists the .awr files of dir, newest first, and updates the index file.
+        // A missing or damaged index file is rebuilt.
+        void refresh(const std::filesystem::path& dir);
+
+        const std::filesystem::path& directory() const noexcept { return m_dir; }
+        const std::vector<entry>& entries() const noexcept { return m_entries; }
+        // Headers read by the last refresh, the other entries came from the index
+        std::size_t headers_read() const noexcept { return m_headers_read; }
+
+    private:
+        std::filesystem::path m_dir;
+        std::vector<entry> m_entries;
+        std::size_t m_headers_read = 0;
+    };
+
+    // "2024-01-31 12:34:56" in local time
+    std::string format_replay_date(std::int64_t date);
+}
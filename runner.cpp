@@ -1,11 +1,448 @@
 #include "runner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include "network.hpp"
+#include "timestep.hpp"
+#include "main.hpp"
 
 
 namespace awe
 {
+    namespace detailed
+    {
+        // Branches of a speculation, which get half of the cores left by the
+        // renderer and the simulation thread, the pool keeps the others
+        std::size_t speculation_branches()
+        {
+            const unsigned int cores = std::thread::hardware_concurrency();
+            return cores > 3 ? std::min<std::size_t>(speculation::branch_count, (cores - 2) / 2) : 0;
+        }
+
+        // One core is left to the renderer and one to each speculative branch,
+        // a pool without a worker is no pool
+        std::shared_ptr<thread_pool> make_simulation_pool(std::size_t branches)
+        {
+            const std::size_t cores = std::thread::hardware_concurrency();
+            return cores > branches + 2 ? std::make_shared<thread_pool>(static_cast<unsigned int>(cores - 1 - branches)) : nullptr;
+        }
+        // Shared by the interactive runners
+        std::shared_ptr<thread_pool> simulation_pool()
+        {
+            static const auto pool = make_simulation_pool(0);
+            return pool;
+        }
+        // Shared by the network runners that speculate
+        std::shared_ptr<thread_pool> speculating_simulation_pool()
+        {
+            static const auto pool = make_simulation_pool(speculation_branches());
+            return pool;
+        }
+    }
+
     local_multi_runner::local_multi_runner()
     {
         std::random_device dev;
         m_game = std::make_shared<game_world>(dev());
+        m_game->set_thread_pool(detailed::simulation_pool());
+    }
+
+    void local_multi_runner::update()
+    {
+        auto& im = application::instance().get_input_manager();
+        frame_input input;
+        for(std::size_t i = 0; i < max_players; ++i)
+            input.keys[i] = im.keys(static_cast<int>(i));
+        m_game->apply_input(input);
+        m_game->update();
+    }
+    void local_multi_runner::publish()
+    {
+        m_game->publish_snapshot();
+    }
+    render_stats local_multi_runner::render(SDL_Renderer* ren, const texture_atlas* atlas, float alpha)
+    {
+        return m_game->render(ren, atlas, alpha);
+    }
+
+    synctest_runner::synctest_runner(unsigned int seed, unsigned int check_distance)
+        : m_game(std::make_shared<game_world>(seed)),
+        m_check_distance(check_distance),
+        m_history(check_distance == 0 ? 1 : check_distance) {}
+
+    bool synctest_runner::tick(const frame_input& input)
+    {
+        if(m_desync_frame)
+            return false;
+
+        auto& rec = m_history[m_recorded % m_history.size()];
+        m_game->save_state(rec.state);
+        rec.input = input;
+        m_game->apply_input(input);
+        m_game->update();
+        rec.checksum = m_game->checksum();
+        ++m_recorded;
+
+        if(m_check_distance == 0)
+            return true;
+
+        // Roll back as far as the history allows and resimulate up to now
+        std::size_t depth = std::min<std::size_t>(m_recorded, m_history.size());
+        std::size_t first = m_recorded - depth;
+        m_game->load_state(m_history[first % m_history.size()].state);
+        for(std::size_t i = first; i < m_recorded; ++i)
+        {
+            const auto& r = m_history[i % m_history.size()];
+            m_game->apply_input(r.input);
+            m_game->update();
+            if(m_game->checksum() != r.checksum)
+            {
+                m_desync_frame = m_game->framecount();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    headless_runner::headless_runner(unsigned int seed, std::unique_ptr<input_source> input)
+        : m_game(std::make_shared<game_world>(seed)),
+        m_input(std::move(input)) {}
+
+    void headless_runner::update()
+    {
+        if(m_finished)
+            return;
+        auto input = m_input->next();
+        if(!input)
+        {
+            m_finished = true;
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        m_game->apply_input(*input);
+        m_game->update();
+        auto end = std::chrono::steady_clock::now();
+
+        m_stats.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        on_input(*input);
+    }
+
+    void headless_runner::run(std::uint64_t max_ticks)
+    {
+        m_stats.reserve(m_stats.count() + max_ticks);
+        for(std::uint64_t i = 0; i < max_ticks && !m_finished; ++i)
+            update();
+    }
+
+    replay_runner::replay_runner(replay_file file)
+        : m_file(std::move(file)),
+        m_game(std::make_shared<game_world>(m_file.info().seed))
+    {
+        m_game->spawn_entities(m_file.info().entities);
+        m_game->set_thread_pool(detailed::simulation_pool());
+        m_game->save_state(m_initial);
+    }
+
+    void replay_runner::update()
+    {
+        std::uint64_t target = m_seek_to.exchange(no_seek);
+        if(target != no_seek)
+            go_to(target);
+        if(m_paused || failed())
+            return;
+
+        if(unsigned int speed = m_speed; speed > 0)
+        {
+            for(unsigned int i = 0; i < speed && step(); ++i) {}
+            return;
+        }
+
+        // Unlimited, leaves some of the tick to the other threads
+        using clock = std::chrono::steady_clock;
+        auto budget = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(unlimited_budget / fixed_timestep::default_rate)
+        );
+        auto deadline = clock::now() + budget;
+        while(clock::now() < deadline && step()) {}
+    }
+    void replay_runner::publish()
+    {
+        m_game->publish_snapshot();
+    }
+    render_stats replay_runner::render(SDL_Renderer* ren, const texture_atlas* atlas, float alpha)
+    {
+        return m_game->render(ren, atlas, alpha);
+    }
+
+    bool replay_runner::step()
+    {
+        std::uint64_t f = m_frame;
+        if(f >= frames() || failed())
+            return false;
+        if(f < m_chunk_first || f - m_chunk_first >= m_inputs.size())
+        {
+            // A damaged chunk ends the replay early
+            try
+            {
+                std::size_t i = m_file.find_chunk(f);
+                m_file.read_inputs(i, m_inputs);
+                m_chunk_first = m_file.chunk(i).first_frame;
+            }
+            catch(const std::runtime_error&)
+            {
+                m_inputs.clear();
+            }
+            if(f < m_chunk_first || f - m_chunk_first >= m_inputs.size())
+                return false;
+        }
+        m_game->apply_input(m_inputs[f - m_chunk_first]);
+        m_game->update();
+        m_frame = f + 1;
+        return true;
+    }
+
+    void replay_runner::go_to(std::uint64_t frame)
+    {
+        frame = std::min(frame, frames());
+        // Keyframes at or before limit are tried, the initial state once there are none left
+        std::optional<std::uint64_t> limit = frame;
+        for(;;)
+        {
+            auto k = limit ? m_file.find_keyframe(*limit) : std::nullopt;
+            const std::uint64_t from = k ? k->first : 0;
+            // Plays on when no keyframe lies in between
+            if(m_frame <= frame && m_frame >= from)
+                break;
+            try
+            {
+                // Leaves the world untouched if the state is damaged
+                m_game->load_state(k ? k->second : std::span<const std::byte>(m_initial));
+                m_frame = from;
+                break;
+            }
+            catch(const std::exception& e)
+            {
+                if(!k)
+                {
+                    fail(std::string("Failed to load the start of the replay: ") + e.what());
+                    return;
+                }
+                limit = from > 0 ? std::optional<std::uint64_t>(from - 1) : std::nullopt;
+            }
+        }
+        while(m_frame < frame && step()) {}
+    }
+
+    void replay_runner::fail(std::string msg)
+    {
+        if(failed())
+            return;
+        m_error = std::move(msg);
+        m_failed.store(true, std::memory_order_release);
+    }
+
+    network_runner::network_runner(std::shared_ptr<network> net, unsigned int seed, int local_player, std::uint64_t resume_frame, bool speculate)
+        : m_network(std::move(net)),
+        m_session(seed, local_player, input_delay, speculate ? detailed::speculation_branches() : 0),
+        m_delay(std::make_shared<delay_controller>(fixed_timestep::default_rate, input_delay)),
+        m_resume(resume_files::of(seed, local_player))
+    {
+        m_session.game()->set_thread_pool(
+            speculate ? detailed::speculating_simulation_pool() : detailed::simulation_pool()
+        );
+
+        if(resume_frame > 0)
+            m_session.resume(load_resume_point(seed, m_resume, resume_frame));
+        try
+        {
+            // The log continues after the resumed frame, a new game drops the files of older ones
+            if(resume_frame > 0)
+                std::filesystem::resize_file(m_resume.log, resume_frame * max_players);
+            else
+                resume_files::remove_all(local_player);
+            m_resume_log = std::make_unique<input_log_writer>(m_resume.log, resume_frame > 0);
+        }
+        catch(const std::exception& e)
+        {
+            stop_resume_files(&e);
+        }
+        m_session.on_confirm.connect([this](std::uint64_t frame, const frame_input& input, const state_buffer& state) {
+            keep_resume_files(frame, input, state);
+            if(m_replay)
+            {
+                m_replay->record(input);
+                m_replay->set_checksum(m_session.checksums()[frame]);
+                if(m_replay->wants_keyframe())
+                    m_replay->record_keyframe(state);
+            }
+        });
+
+        // Write errors are not reported here,
+        // the message thread fails on the same socket and reports them
+        m_session.on_send_input.connect([this](std::uint64_t frame, int player, input_mask keys) {
+            boost::system::error_code ec;
+            std::lock_guard guard(m_network->get_write_mutex());
+            m_network->send_msg<AWEMSG_INPUT>({ frame, player, keys }, ec);
+        });
+        m_session.on_send_checksum.connect([this](std::uint64_t frame, std::uint64_t checksum) {
+            boost::system::error_code ec;
+            std::lock_guard guard(m_network->get_write_mutex());
+            m_network->send_msg<AWEMSG_CHECKSUM>({ frame, checksum }, ec);
+        });
+        m_session.on_desync.connect([this](std::uint64_t frame) {
+            desync(frame);
+        });
+
+        m_connections.emplace_back(m_network->register_msgproc<AWEMSG_INPUT>([this](const message_tuple<AWEMSG_INPUT>::type& msg) {
+            m_session.add_remote_input(get<0>(msg), get<1>(msg), get<2>(msg));
+        }));
+        m_connections.emplace_back(m_network->register_msgproc<AWEMSG_CHECKSUM>([this](const message_tuple<AWEMSG_CHECKSUM>::type& msg) {
+            m_session.add_remote_checksum(get<0>(msg), get<1>(msg));
+        }));
+        m_connections.emplace_back(m_network->register_msgproc<AWEMSG_PING>([this](const message_tuple<AWEMSG_PING>::type& msg) {
+            boost::system::error_code ec;
+            std::lock_guard guard(m_network->get_write_mutex());
+            m_network->send_msg<AWEMSG_PONG>({ get<0>(msg) }, ec);
+        }));
+        m_connections.emplace_back(m_network->register_msgproc<AWEMSG_PONG>([this](const message_tuple<AWEMSG_PONG>::type& msg) {
+            auto sent = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(get<0>(msg)));
+            std::chrono::duration<double, std::milli> rtt = std::chrono::steady_clock::now() - sent;
+            m_delay->add_rtt(rtt.count());
+        }));
+    }
+
+    void network_runner::update()
+    {
+        // Both key sets control the local player
+        auto& im = application::instance().get_input_manager();
+        m_session.advance(im.keys(0) | im.keys(1));
+
+        if(m_resume_log)
+        {
+            // Nothing left to resume once every frame of a completed game is confirmed
+            if(game()->completed() && m_session.confirmed_frames() >= m_session.current_frame())
+                stop_resume_files(nullptr);
+            else
+            {
+                try
+                {
+                    m_resume_log->flush();
+                }
+                catch(const std::exception& e)
+                {
+                    stop_resume_files(&e);
+                }
+            }
+        }
+
+        if(m_ticks++ % ping_interval == 0)
+        {
+            boost::system::error_code ec;
+            std::lock_guard guard(m_network->get_write_mutex());
+            auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+            m_network->send_msg<AWEMSG_PING>({ static_cast<std::uint64_t>(now) }, ec);
+        }
+        m_session.set_input_delay(m_delay->update(
+            m_session.remote_inputs(),
+            m_session.mispredicted_inputs()
+        ));
+    }
+    void network_runner::publish()
+    {
+        m_session.game()->publish_snapshot();
+    }
+    render_stats network_runner::render(SDL_Renderer* ren, const texture_atlas* atlas, float alpha)
+    {
+        return m_session.game()->render(ren, atlas, alpha);
+    }
+
+    void network_runner::record_replay(const std::filesystem::path& path)
+    {
+        m_replay = std::make_unique<replay_recorder>(path, replay_info{ m_session.seed(), max_players, 0 });
+        // The frames before a resumed one, the later ones are recorded by on_confirm
+        for(auto& input : m_session.confirmed_inputs().first(m_session.checksums().size()))
+            m_replay->record(input);
+        if(m_replay->frames() > 0)
+            m_replay->set_checksum(m_session.checksums().back());
+        // The game may already be predicting past the confirmed frames
+        if(m_replay->frames() > 0 && m_session.current_frame() == m_replay->frames())
+        {
+            state_buffer state;
+            m_session.game()->save_state(state);
+            m_replay->record_keyframe(state);
+        }
+    }
+
+    void network_runner::keep_resume_files(std::uint64_t frame, const frame_input& input, const state_buffer& state)
+    {
+        if(!m_resume_log)
+            return;
+        try
+        {
+            m_resume_log->write(input);
+            // Both peers save at the same frames
+            if((frame + 1) % save_interval == 0)
+            {
+                write_save_state(
+                    m_resume.save,
+                    m_session.seed(),
+                    m_session.local_player(),
+                    frame + 1,
+                    state,
+                    m_session.checksums()
+                );
+            }
+        }
+        catch(const std::exception& e)
+        {
+            stop_resume_files(&e);
+        }
+    }
+
+    void network_runner::stop_resume_files(const std::exception* e)
+    {
+        m_resume_log.reset();
+        std::error_code ec;
+        std::filesystem::remove(m_resume.save, ec);
+        std::filesystem::remove(m_resume.log, ec);
+        if(e)
+        {
+            std::string msg = "The game can't be resumed after a crash: ";
+            msg += e->what();
+            notify(std::move(msg));
+        }
+    }
+
+    void network_runner::desync(std::uint64_t frame)
+    {
+        std::string filename =
+            "desync_" +
+            std::to_string(frame) +
+            "_" +
+            std::to_string(m_session.local_player() + 1) +
+            "P.bin";
+        std::string msg = "Desync at frame " + std::to_string(frame);
+        try
+        {
+            m_session.make_dump().save(filename);
+            msg += ", dump written to " + filename;
+        }
+        catch(const std::exception& e)
+        {
+            msg += ", failed to write dump: ";
+            msg += e.what();
+        }
+        notify(std::move(msg));
+    }
+
+    void network_runner::notify(std::string msg)
+    {
+        auto& chat = application::instance().get_chatroom();
+        std::lock_guard guard(chat.get_mutex());
+        chat.add_record(std::move(msg), chatroom::NOTIFICATION);
     }
 }
@@ -1,8 +1,20 @@
 #pragma once
 
+#include <atomic>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <boost/signals2.hpp>
 #include "game.hpp"
+#include "delay_controller.hpp"
 #include "input.hpp"
+#include "input_source.hpp"
+#include "replay.hpp"
+#include "savestate.hpp"
+#include "session.hpp"
+#include "stats.hpp"
 
 
 namespace awe
@@ -11,6 +23,14 @@ namespace awe
     {
     public:
         virtual ~runner() = default;
+
+        // Called once per simulation tick
+        virtual void update() {}
+        // Called after the ticks of a step, hands the state over to rendering
+        virtual void publish() {}
+        // Called once per displayed frame, possibly on another thread.
+        // alpha is the fraction of the next tick already elapsed.
+        virtual render_stats render(SDL_Renderer* /*ren*/, const texture_atlas* /*atlas*/, float /*alpha*/) { return {}; }
     };
 
     //  Local multi players
@@ -19,9 +39,190 @@ namespace awe
     public:
         local_multi_runner();
 
+        void update() override;
+        void publish() override;
+        render_stats render(SDL_Renderer* ren, const texture_atlas* atlas, float alpha) override;
+
         std::shared_ptr<game_world>& game() noexcept { return m_game; }
 
     private:
         std::shared_ptr<game_world> m_game;
     };
+
+    //  Determinism check without network.
+    //  Every tick rolls the world back by check_distance frames, resimulates
+    //  them with the recorded inputs and compares the checksums to the first run.
+    class synctest_runner : public runner
+    {
+    public:
+        synctest_runner(unsigned int seed, unsigned int check_distance);
+
+        // Returns false once a checksum mismatch has been detected
+        bool tick(const frame_input& input);
+
+        std::shared_ptr<game_world>& game() noexcept { return m_game; }
+
+        unsigned int check_distance() const noexcept { return m_check_distance; }
+        // Frame of the first mismatch
+        std::optional<std::uint64_t> desync_frame() const noexcept { return m_desync_frame; }
+
+    private:
+        struct frame_record
+        {
+            state_buffer state; // before the input is applied
+            frame_input input;
+            std::uint64_t checksum = 0; // after the update
+        };
+
+        std::shared_ptr<game_world> m_game;
+        unsigned int m_check_distance;
+        std::vector<frame_record> m_history; // ring buffer
+        std::size_t m_recorded = 0;
+        std::optional<std::uint64_t> m_desync_frame;
+    };
+
+    //  No window and no pacing, ticks as fast as possible.
+    //  Measures the cost of the simulation alone.
+    class headless_runner : public runner
+    {
+    public:
+        headless_runner(unsigned int seed, std::unique_ptr<input_source> input);
+
+        // Simulates one tick, does nothing once the input is exhausted
+        void update() override;
+        // Ticks until the input is exhausted or max_ticks have been simulated
+        void run(std::uint64_t max_ticks);
+
+        bool finished() const noexcept { return m_finished; }
+        const tick_stats& stats() const noexcept { return m_stats; }
+
+        std::shared_ptr<game_world>& game() noexcept { return m_game; }
+
+        // Called with the inputs of every simulated tick
+        boost::signals2::signal<void(const frame_input&)> on_input;
+
+    private:
+        std::shared_ptr<game_world> m_game;
+        std::unique_ptr<input_source> m_input;
+        tick_stats m_stats;
+        bool m_finished = false;
+    };
+
+    //  Plays a replay back at a multiple of real time or as fast as possible.
+    //  Seeking resimulates from the closest keyframe at or before the target,
+    //  at most the keyframe interval of the recording.
+    class replay_runner : public runner
+    {
+    public:
+        static constexpr std::uint64_t no_seek = std::numeric_limits<std::uint64_t>::max();
+        // Share of a tick spent simulating at unlimited speed
+        static constexpr double unlimited_budget = 0.75;
+
+        explicit replay_runner(replay_file file);
+
+        void update() override;
+        void publish() override;
+        render_stats render(SDL_Renderer* ren, const texture_atlas* atlas, float alpha) override;
+
+        // May be called from any thread, applied on the next update
+        void seek(std::uint64_t frame) noexcept { m_seek_to = frame; }
+        // Frames per tick, 0 is unlimited
+        void set_speed(unsigned int speed) noexcept { m_speed = speed; }
+        void set_paused(bool paused) noexcept { m_paused = paused; }
+        unsigned int speed() const noexcept { return m_speed; }
+        bool paused() const noexcept { return m_paused; }
+
+        // Frames played so far
+        std::uint64_t frame() const noexcept { return m_frame; }
+        std::uint64_t frames() const noexcept { return m_file.frames(); }
+        bool finished() const noexcept { return frame() >= frames(); }
+
+        // Simulates one frame, returns false at the end of the replay
+        bool step();
+        // Jumps to frame right away, on the simulation thread only.
+        // A keyframe that can't be loaded falls back to an earlier one,
+        // down to the start of the replay.
+        void go_to(std::uint64_t frame);
+
+        // Set when even the start of the replay can't be loaded,
+        // the runner doesn't play on afterwards
+        bool failed() const noexcept { return m_failed.load(std::memory_order_acquire); }
+        // Valid once failed() returns true
+        const std::string& error() const noexcept { return m_error; }
+
+        const replay_file& file() const noexcept { return m_file; }
+        std::shared_ptr<game_world>& game() noexcept { return m_game; }
+
+    private:
+        replay_file m_file;
+        std::shared_ptr<game_world> m_game;
+        state_buffer m_initial; // before frame 0
+
+        // Inputs of the chunk being played, read from the mapping when entered
+        std::uint64_t m_chunk_first = 0;
+        std::vector<frame_input> m_inputs;
+
+        std::atomic<std::uint64_t> m_frame = 0;
+        std::atomic<unsigned int> m_speed = 1;
+        std::atomic_bool m_paused = false;
+        std::atomic<std::uint64_t> m_seek_to = no_seek;
+        std::string m_error;
+        std::atomic_bool m_failed = false;
+
+        void fail(std::string msg);
+    };
+
+    class network;
+
+    //  Two players over the network with rollback
+    class network_runner : public runner
+    {
+    public:
+        // Until the first round-trip time is measured
+        static constexpr unsigned int input_delay = 2;
+        // Ticks between two pings
+        static constexpr std::uint64_t ping_interval = 30;
+        // Confirmed frames between two save states kept for resuming
+        static constexpr std::uint64_t save_interval = 600;
+
+        // A resume_frame above 0 continues from the resume files of the game,
+        // the peer has to use the same frame. speculate runs speculative
+        // branches on the cores the renderer and the simulation leave idle,
+        // none on up to 3 cores.
+        network_runner(
+            std::shared_ptr<network> net,
+            unsigned int seed,
+            int local_player,
+            std::uint64_t resume_frame = 0,
+            bool speculate = true
+        );
+
+        void update() override;
+        void publish() override;
+        render_stats render(SDL_Renderer* ren, const texture_atlas* atlas, float alpha) override;
+
+        std::shared_ptr<game_world>& game() noexcept { return m_session.game(); }
+        rollback_session& session() noexcept { return m_session; }
+        std::shared_ptr<const delay_controller> get_delay_controller() const noexcept { return m_delay; }
+
+        // Records the confirmed inputs from frame 0 on, call before the first update.
+        // Throws std::runtime_error if the file can't be created.
+        void record_replay(const std::filesystem::path& path);
+
+    private:
+        std::shared_ptr<network> m_network;
+        rollback_session m_session;
+        std::shared_ptr<delay_controller> m_delay;
+        std::uint64_t m_ticks = 0;
+        std::vector<boost::signals2::scoped_connection> m_connections;
+
+        resume_files m_resume;
+        std::unique_ptr<input_log_writer> m_resume_log;
+        std::unique_ptr<replay_recorder> m_replay;
+
+        void keep_resume_files(std::uint64_t frame, const frame_input& input, const state_buffer& state);
+        void stop_resume_files(const std::exception* e);
+        void desync(std::uint64_t frame);
+        void notify(std::string msg);
+    };
 }
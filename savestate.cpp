@@ -0,0 +1,239 @@
+#include "savestate.hpp"
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <boost/interprocess/exceptions.hpp>
+#include "input_source.hpp"
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        constexpr char save_magic[8] = { 'A', 'W', 'E', 'S', 'A', 'V', 'E', '\0' };
+        constexpr std::uint32_t save_version = 1;
+
+        // The checksums start 8-byte aligned after the state
+        constexpr std::uint64_t checksums_offset(std::uint64_t state_size) noexcept
+        {
+            return sizeof(save_header) + (state_size + 7) / 8 * 8;
+        }
+
+        constexpr std::string_view resume_prefix = "resume_";
+        std::string resume_suffix(int local_player)
+        {
+            return "_" + std::to_string(local_player + 1) + "P";
+        }
+
+        // Seed of a "resume_<seed>_<n>P.log" file of local_player
+        std::optional<unsigned int> resume_log_seed(const std::filesystem::path& path, int local_player)
+        {
+            if(path.extension() != ".log")
+                return std::nullopt;
+            std::string stem = path.stem().string();
+            std::string_view prefix = resume_prefix;
+            std::string suffix = resume_suffix(local_player);
+            if(stem.size() <= prefix.size() + suffix.size() || !stem.starts_with(prefix) || !stem.ends_with(suffix))
+                return std::nullopt;
+
+            unsigned int seed = 0;
+            const char* first = stem.data() + prefix.size();
+            const char* last = stem.data() + stem.size() - suffix.size();
+            auto [ptr, ec] = std::from_chars(first, last, seed);
+            if(ec != std::errc() || ptr != last)
+                return std::nullopt;
+            return seed;
+        }
+    }
+
+    void write_save_state(
+        const std::filesystem::path& path,
+        unsigned int seed,
+        int local_player,
+        std::uint64_t frame,
+        std::span<const std::byte> state,
+        std::span<const std::uint64_t> checksums
+    ) {
+        save_header header{};
+        std::copy(std::begin(detailed::save_magic), std::end(detailed::save_magic), header.magic);
+        header.version = detailed::save_version;
+        header.seed = seed;
+        header.local_player = local_player;
+        header.frame = frame;
+        header.state_size = state.size();
+        header.checksum_count = checksums.size();
+
+        state_buffer buf;
+        buf.reserve(detailed::checksums_offset(state.size()) + checksums.size() * sizeof(std::uint64_t));
+        state_writer w(buf);
+        w.write_bytes(&header, sizeof(header));
+        w.write_bytes(state.data(), state.size());
+        buf.resize(detailed::checksums_offset(state.size()));
+        w.write_array(checksums.data(), checksums.size());
+
+        std::filesystem::path tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::binary);
+            ofs.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+            if(!ofs)
+                throw std::runtime_error("failed to write " + tmp.string());
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if(ec)
+            throw std::runtime_error("failed to write " + path.string());
+    }
+
+    mapped_save_state::mapped_save_state(const std::filesystem::path& path)
+    {
+        namespace bip = boost::interprocess;
+        try
+        {
+            m_file = bip::file_mapping(path.string().c_str(), bip::read_only);
+            m_region = bip::mapped_region(m_file, bip::read_only);
+        }
+        catch(const bip::interprocess_exception&)
+        {
+            throw std::runtime_error("failed to open " + path.string());
+        }
+
+        if(m_region.get_size() < sizeof(save_header))
+            throw std::runtime_error(path.string() + " is not a save state");
+        auto& h = header();
+        if(!std::equal(std::begin(h.magic), std::end(h.magic), detailed::save_magic))
+            throw std::runtime_error(path.string() + " is not a save state");
+        if(h.version != detailed::save_version)
+            throw std::runtime_error(path.string() + " has an unsupported version");
+        const std::uint64_t size = m_region.get_size();
+        if(
+            h.state_size > size ||
+            detailed::checksums_offset(h.state_size) > size ||
+            h.checksum_count > (size - detailed::checksums_offset(h.state_size)) / sizeof(std::uint64_t)
+        ) {
+            throw std::runtime_error(path.string() + " is truncated");
+        }
+    }
+
+    std::span<const std::byte> mapped_save_state::state() const noexcept
+    {
+        auto* base = static_cast<const std::byte*>(m_region.get_address());
+        return { base + sizeof(save_header), static_cast<std::size_t>(header().state_size) };
+    }
+    std::span<const boost::endian::little_uint64_t> mapped_save_state::checksums() const noexcept
+    {
+        auto* base = static_cast<const std::byte*>(m_region.get_address());
+        return {
+            reinterpret_cast<const boost::endian::little_uint64_t*>(base + detailed::checksums_offset(header().state_size)),
+            static_cast<std::size_t>(header().checksum_count)
+        };
+    }
+
+    resume_files resume_files::of(unsigned int seed, int local_player)
+    {
+        std::string stem =
+            std::string(detailed::resume_prefix) +
+            std::to_string(seed) +
+            detailed::resume_suffix(local_player);
+        return { stem + ".sav", stem + ".log" };
+    }
+
+    std::optional<std::pair<unsigned int, resume_files>> resume_files::find_latest(int local_player)
+    {
+        std::optional<std::pair<unsigned int, resume_files>> latest;
+        std::filesystem::file_time_type latest_time;
+        std::error_code ec;
+        for(auto& entry : std::filesystem::directory_iterator(std::filesystem::current_path(), ec))
+        {
+            auto seed = detailed::resume_log_seed(entry.path().filename(), local_player);
+            if(!seed)
+                continue;
+            auto time = entry.last_write_time(ec);
+            if(ec)
+                continue;
+            if(!latest || time > latest_time)
+            {
+                latest.emplace(*seed, of(*seed, local_player));
+                latest_time = time;
+            }
+        }
+
+        return latest;
+    }
+
+    void resume_files::remove_all(int local_player)
+    {
+        std::vector<unsigned int> seeds;
+        std::error_code ec;
+        for(auto& entry : std::filesystem::directory_iterator(std::filesystem::current_path(), ec))
+        {
+            if(auto seed = detailed::resume_log_seed(entry.path().filename(), local_player))
+                seeds.push_back(*seed);
+        }
+        for(unsigned int seed : seeds)
+        {
+            auto files = of(seed, local_player);
+            std::filesystem::remove(files.save, ec);
+            std::filesystem::remove(files.log, ec);
+        }
+    }
+
+    std::uint64_t resume_files::available_frames() const
+    {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(log, ec);
+        return ec ? 0 : size / max_players;
+    }
+
+    resume_point load_resume_point(unsigned int seed, const resume_files& files, std::uint64_t frame)
+    {
+        resume_point point;
+        point.frame = frame;
+        point.inputs.reserve(frame);
+        point.checksums.reserve(frame);
+
+        auto world = std::make_unique<game_world>(seed);
+        try
+        {
+            mapped_save_state save(files.save);
+            if(save.seed() == seed && save.frame() <= frame && save.checksums().size() == save.frame())
+            {
+                world->load_state(save.state());
+                point.checksums.assign(save.checksums().begin(), save.checksums().end());
+            }
+        }
+        catch(const std::exception&)
+        {
+            // Resimulated from the seed instead
+            world = std::make_unique<game_world>(seed);
+            point.checksums.clear();
+        }
+
+        if(frame > 0)
+        {
+            recorded_input_source log(files.log);
+            while(point.inputs.size() < frame)
+            {
+                auto input = log.next();
+                if(!input)
+                    throw std::runtime_error(files.log.string() + " is too short");
+                point.inputs.push_back(*input);
+            }
+        }
+
+        for(std::uint64_t f = point.checksums.size(); f < frame; ++f)
+        {
+            world->apply_input(point.inputs[f]);
+            world->update();
+            point.checksums.push_back(world->checksum());
+        }
+        world->save_state(point.state);
+
+        return point;
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+#include <boost/endian/arithmetic.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "game.hpp"
+
+
+namespace awe
+{
+    //  Fixed-size header at the start of a save state file.
+    //  The fields are stored little-endian byte by byte, so the header can be
+    //  read in place from the mapped file on any platform.
+    //  It is followed by the state and a checksum for every frame before it.
+    struct save_header
+    {
+        char magic[8];
+        boost::endian::little_uint32_t version;
+        boost::endian::little_uint32_t seed;
+        boost::endian::little_int32_t local_player;
+        boost::endian::little_uint32_t reserved;
+        boost::endian::little_uint64_t frame; // state before this frame
+        boost::endian::little_uint64_t state_size;
+        boost::endian::little_uint64_t checksum_count;
+    };
+    static_assert(sizeof(save_header) == 48);
+
+    // Writes to a temporary file first and renames it,
+    // a crash while writing leaves the previous save in place.
+    // Throws std::runtime_error on failure.
+    void write_save_state(
+        const std::filesystem::path& path,
+        unsigned int seed,
+        int local_player,
+        std::uint64_t frame,
+        std::span<const std::byte> state,
+        std::span<const std::uint64_t> checksums
+    );
+
+    //  Read-only memory mapping of a save state file.
+    //  Nothing is parsed or copied, state() can be passed to
+    //  game_world::load_state as is.
+    class mapped_save_state
+    {
+    public:
+        // Throws std::runtime_error if the file can't be mapped or isn't a save state
+        explicit mapped_save_state(const std::filesystem::path& path);
+
+        unsigned int seed() const noexcept { return header().seed; }
+        int local_player() const noexcept { return header().local_player; }
+        std::uint64_t frame() const noexcept { return header().frame; }
+
+        std::span<const std::byte> state() const noexcept;
+        std::span<const boost::endian::little_uint64_t> checksums() const noexcept;
+
+    private:
+        boost::interprocess::file_mapping m_file;
+        boost::interprocess::mapped_region m_region;
+
+        const save_header& header() const noexcept
+        {
+            return *static_cast<const save_header*>(m_region.get_address());
+        }
+    };
+
+    //  Files kept by each peer during a network game to resume it after a
+    //  crash or a restart: a save state written every few seconds and the
+    //  confirmed inputs since frame 0, appended every tick.
+    struct resume_files
+    {
+        std::filesystem::path save;
+        std::filesystem::path log; // readable by recorded_input_source
+
+        static resume_files of(unsigned int seed, int local_player);
+        // Seed and files of the most recently written log of local_player
+        // in the working directory
+        static std::optional<std::pair<unsigned int, resume_files>> find_latest(int local_player);
+        // Removes the files of every game of local_player
+        static void remove_all(int local_player);
+
+        // Frames whose inputs are logged, 0 without a log
+        std::uint64_t available_frames() const;
+    };
+
+    //  A session state to continue from
+    struct resume_point
+    {
+        std::uint64_t frame = 0; // state before this frame
+        state_buffer state;
+        // Inputs and checksum after each frame before it
+        std::vector<frame_input> inputs;
+        std::vector<std::uint64_t> checksums;
+    };
+
+    // Loads the save state unless it is past frame, or starts from the seed
+    // without a usable one, and simulates the logged inputs up to frame.
+    // Throws std::runtime_error if fewer than frame inputs are logged.
+    resume_point load_resume_point(unsigned int seed, const resume_files& files, std::uint64_t frame);
+}
@@ -0,0 +1,302 @@
+#include "session.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        constexpr std::uint64_t no_rollback = std::numeric_limits<std::uint64_t>::max();
+        constexpr std::uint8_t all_players = (1u << max_players) - 1;
+    }
+
+    rollback_session::rollback_session(unsigned int seed, int local_player, unsigned int input_delay, std::size_t speculation_branches)
+        : m_game(std::make_shared<game_world>(seed)),
+        m_seed(seed),
+        m_local_player(local_player),
+        m_input_delay(std::min(input_delay, max_input_delay)),
+        m_target_delay(m_input_delay)
+    {
+        if(speculation_branches > 0)
+            m_speculation = std::make_unique<speculation>(local_player, max_rollback, speculation_branches);
+    }
+
+    void rollback_session::resume(resume_point point)
+    {
+        m_game->load_state(point.state);
+        m_inputs = std::move(point.inputs);
+        m_confirmed.assign(m_inputs.size(), detailed::all_players);
+        m_confirmed_frames = point.frame;
+        m_next_local_frame = point.frame;
+        m_checksums = std::move(point.checksums);
+    }
+
+    void rollback_session::add_remote_input(std::uint64_t frame, int player, input_mask keys)
+    {
+        std::lock_guard guard(m_mutex);
+        m_pending_inputs.push_back({ frame, player, keys });
+    }
+    void rollback_session::add_remote_checksum(std::uint64_t frame, std::uint64_t checksum)
+    {
+        std::lock_guard guard(m_mutex);
+        m_pending_checksums.emplace_back(frame, checksum);
+    }
+
+    bool rollback_session::advance(input_mask local_keys)
+    {
+        if(m_desync_frame)
+            return false;
+
+        const std::uint64_t frame = current_frame();
+        std::uint64_t rollback_from = detailed::no_rollback;
+
+        // The input of this tick is dropped, that of the frame before is used
+        // for it instead. Invisible when they are the same.
+        if(
+            m_target_delay < m_input_delay &&
+            (m_next_local_frame == 0 || m_inputs[m_next_local_frame - 1].keys[m_local_player] == local_keys)
+        ) {
+            --m_input_delay;
+        }
+        else if(m_target_delay > m_input_delay)
+            m_input_delay = m_target_delay;
+
+        // Local input is scheduled input_delay frames ahead
+        for(; m_next_local_frame <= frame + m_input_delay; ++m_next_local_frame)
+        {
+            rollback_from = std::min(
+                rollback_from,
+                confirm_input(m_next_local_frame, m_local_player, local_keys)
+            );
+            on_send_input(m_next_local_frame, m_local_player, local_keys);
+        }
+
+        std::vector<pending_input> inputs;
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> checksums;
+        {
+            std::lock_guard guard(m_mutex);
+            inputs.swap(m_pending_inputs);
+            checksums.swap(m_pending_checksums);
+        }
+        // The remote peer stalls max_rollback frames past the inputs it has from
+        // us, and schedules its own inputs at most max_input_delay after that
+        const std::uint64_t max_remote_frame = m_next_local_frame + max_rollback + max_input_delay;
+        for(auto& i : inputs)
+        {
+            if(i.frame > max_remote_frame)
+                continue;
+            rollback_from = std::min(rollback_from, confirm_input(i.frame, i.player, i.keys));
+        }
+        while(
+            m_confirmed_frames < m_confirmed.size() &&
+            m_confirmed[m_confirmed_frames] == detailed::all_players
+        ) {
+            ++m_confirmed_frames;
+        }
+
+        if(rollback_from < frame)
+        {
+            std::uint64_t resume = adopt_speculation(rollback_from, frame);
+            m_game->load_state(snapshot_before(resume));
+            for(std::uint64_t f = resume; f < frame; ++f)
+                simulate_frame(f);
+            m_adopted_frames += resume - rollback_from;
+            m_resimulated_frames += frame - resume;
+        }
+
+        // Predictions can't run further ahead than the snapshots reach back
+        bool stalled = frame >= m_confirmed_frames + max_rollback;
+        if(!stalled)
+            simulate_frame(frame);
+
+        update_speculation();
+        record_checksums();
+        for(auto& [f, checksum] : checksums)
+        {
+            if(f <= max_remote_frame)
+                m_remote_checksums.emplace(f, checksum);
+        }
+        compare_checksums();
+
+        return !stalled && !m_desync_frame;
+    }
+
+    desync_dump rollback_session::make_dump() const
+    {
+        desync_dump dump;
+        dump.seed = m_seed;
+        dump.local_player = m_local_player;
+        dump.desync_frame = m_desync_frame.value_or(current_frame());
+        dump.inputs.assign(m_inputs.begin(), m_inputs.begin() + m_confirmed_frames);
+        dump.checksums = m_checksums;
+        for(auto& s : m_confirmed_states)
+        {
+            if(!s.state.empty())
+                dump.snapshots.push_back({ s.frame, s.state });
+        }
+        std::sort(
+            dump.snapshots.begin(),
+            dump.snapshots.end(),
+            [](const auto& l, const auto& r) { return l.frame < r.frame; }
+        );
+
+        return dump;
+    }
+
+    void rollback_session::reserve_frame(std::uint64_t frame)
+    {
+        if(m_inputs.size() <= frame)
+        {
+            m_inputs.resize(frame + 1);
+            m_confirmed.resize(frame + 1);
+        }
+    }
+
+    std::uint64_t rollback_session::confirm_input(std::uint64_t frame, int player, input_mask keys)
+    {
+        if(player < 0 || static_cast<std::size_t>(player) >= max_players)
+            return detailed::no_rollback;
+        reserve_frame(frame);
+        const std::uint8_t bit = 1u << player;
+        if(m_confirmed[frame] & bit)
+            return detailed::no_rollback;
+
+        m_confirmed[frame] |= bit;
+        auto& used = m_inputs[frame].keys[player];
+        bool mispredicted = used != keys && frame < current_frame();
+        used = keys;
+
+        if(player != m_local_player)
+        {
+            ++m_remote_inputs;
+            if(mispredicted)
+                ++m_mispredicted_inputs;
+        }
+        return mispredicted ? frame : detailed::no_rollback;
+    }
+
+    void rollback_session::predict_input(std::uint64_t frame)
+    {
+        reserve_frame(frame);
+        auto& input = m_inputs[frame];
+        for(std::size_t p = 0; p < max_players; ++p)
+        {
+            if(!(m_confirmed[frame] & (1u << p)))
+                input.keys[p] = frame > 0 ? m_inputs[frame - 1].keys[p] : 0;
+        }
+    }
+
+    void rollback_session::simulate_frame(std::uint64_t frame)
+    {
+        auto& snap = m_snapshots[frame % m_snapshots.size()];
+        snap.frame = frame;
+        m_game->save_state(snap.state);
+
+        predict_input(frame);
+        m_game->apply_input(m_inputs[frame]);
+        m_game->update();
+    }
+
+    std::uint64_t rollback_session::adopt_speculation(std::uint64_t rollback_from, std::uint64_t frame)
+    {
+        if(!m_speculation || !m_speculation->active())
+            return rollback_from;
+        const std::uint64_t base = m_speculation->base();
+        if(base > rollback_from)
+            return rollback_from;
+
+        // The inputs the frames would be resimulated with
+        for(std::uint64_t f = rollback_from; f < frame; ++f)
+            predict_input(f);
+
+        return m_speculation->adopt(
+            rollback_from,
+            std::span(m_inputs).subspan(base, frame - base),
+            [this](std::uint64_t f, const state_buffer& state) {
+                auto& snap = m_snapshots[f % m_snapshots.size()];
+                snap.frame = f;
+                snap.state = state;
+            }
+        );
+    }
+
+    void rollback_session::update_speculation()
+    {
+        if(!m_speculation)
+            return;
+
+        // Only frames after the last confirmed one can be mispredicted
+        const std::uint64_t base = m_confirmed_frames;
+        const std::uint64_t frame = current_frame();
+        if(base >= frame)
+        {
+            if(m_speculation->active())
+                m_speculation->clear();
+            return;
+        }
+        const frame_input last = base > 0 ? m_inputs[base - 1] : frame_input{};
+        if(!m_speculation->active() || m_speculation->base() > base || m_speculated_frames < base)
+        {
+            m_speculation->restart(base, snapshot_before(base), last);
+            m_speculated_frames = base;
+        }
+        else if(m_speculation->base() != base)
+        {
+            // Branches that guessed the confirmed inputs right carry on
+            const std::uint64_t old_base = m_speculation->base();
+            m_speculation->rebase(
+                base,
+                std::span(m_inputs).subspan(old_base, m_speculated_frames - old_base),
+                last,
+                [this, base]() -> const state_buffer& { return snapshot_before(base); }
+            );
+        }
+        for(; m_speculated_frames < frame; ++m_speculated_frames)
+            m_speculation->push(m_inputs[m_speculated_frames]);
+    }
+
+    const state_buffer& rollback_session::snapshot_before(std::uint64_t frame) const
+    {
+        auto& snap = m_snapshots[frame % m_snapshots.size()];
+        assert(snap.frame == frame);
+        return snap.state;
+    }
+
+    void rollback_session::record_checksums()
+    {
+        const std::uint64_t end = std::min(m_confirmed_frames, current_frame());
+        for(std::uint64_t f = m_checksums.size(); f < end; ++f)
+        {
+            // The state after frame f is the state before frame f + 1
+            auto& kept = m_confirmed_states[(f + 1) % m_confirmed_states.size()];
+            kept.frame = f + 1;
+            if(f + 1 == current_frame())
+                m_game->save_state(kept.state);
+            else
+                kept.state = snapshot_before(f + 1);
+
+            std::uint64_t checksum = m_hasher.update(kept.state);
+            m_checksums.push_back(checksum);
+            on_send_checksum(f, checksum);
+            on_confirm(f, m_inputs[f], kept.state);
+        }
+    }
+
+    void rollback_session::compare_checksums()
+    {
+        auto it = m_remote_checksums.begin();
+        while(it != m_remote_checksums.end() && it->first < m_checksums.size())
+        {
+            if(it->second != m_checksums[it->first])
+            {
+                m_desync_frame = it->first;
+                m_remote_checksums.clear();
+                on_desync(*m_desync_frame);
+                return;
+            }
+            it = m_remote_checksums.erase(it);
+        }
+    }
+}
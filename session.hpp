@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+#include <boost/signals2.hpp>
+#include "game.hpp"
+#include "delay_controller.hpp"
+#include "desync.hpp"
+#include "savestate.hpp"
+#include "speculation.hpp"
+
+
+namespace awe
+{
+    //  Rollback synchronization between two peers.
+    //  Remote inputs that have not arrived yet are predicted by repeating the
+    //  last known ones. When a confirmed input contradicts the prediction the
+    //  world is rolled back to that frame and resimulated. Checksums of fully
+    //  confirmed frames are exchanged to detect desyncs.
+    class rollback_session
+    {
+    public:
+        static constexpr std::size_t max_rollback = 16;
+        // Larger input delays are clamped to the one delay_controller never exceeds
+        static constexpr unsigned int max_input_delay = delay_controller::max_delay;
+        // Confirmed states kept for desync dumps
+        static constexpr std::size_t dump_depth = 64;
+
+        // Runs a speculation with that many branches on threads of their
+        // own, worth it with spare cores only. 0 turns speculation off.
+        rollback_session(unsigned int seed, int local_player, unsigned int input_delay, std::size_t speculation_branches = 0);
+
+        // Continues from a saved point instead of frame 0,
+        // both peers have to resume from the same frame.
+        // Call before the first advance().
+        void resume(resume_point point);
+
+        // Called from the network thread. Inputs for frames further ahead than
+        // the remote peer can be are dropped, the frame comes from the network.
+        void add_remote_input(std::uint64_t frame, int player, input_mask keys);
+        void add_remote_checksum(std::uint64_t frame, std::uint64_t checksum);
+
+        // Simulates the next frame with the local input of this tick.
+        // Returns false if the session has to wait for the remote player.
+        bool advance(input_mask local_keys);
+
+        std::shared_ptr<game_world>& game() noexcept { return m_game; }
+
+        unsigned int seed() const noexcept { return m_seed; }
+        int local_player() const noexcept { return m_local_player; }
+        unsigned int input_delay() const noexcept { return m_input_delay; }
+        // A larger delay repeats the next local input for the added frames.
+        // A smaller one drops a tick of local input per frame, so the delay
+        // only goes down on ticks whose local input repeats the previous one.
+        void set_input_delay(unsigned int delay) noexcept { m_target_delay = std::min(delay, max_input_delay); }
+        std::uint64_t current_frame() const noexcept { return m_game->framecount(); }
+        // Number of frames since the start whose inputs are all confirmed
+        std::uint64_t confirmed_frames() const noexcept { return m_confirmed_frames; }
+        std::optional<std::uint64_t> desync_frame() const noexcept { return m_desync_frame; }
+        // Checksum after each confirmed frame
+        const std::vector<std::uint64_t>& checksums() const noexcept { return m_checksums; }
+        std::span<const frame_input> confirmed_inputs() const noexcept
+        {
+            return std::span(m_inputs).first(m_confirmed_frames);
+        }
+
+        // Confirmed remote inputs, and those that differed from the prediction
+        std::uint64_t remote_inputs() const noexcept { return m_remote_inputs; }
+        std::uint64_t mispredicted_inputs() const noexcept { return m_mispredicted_inputs; }
+        // Frames simulated again after a misprediction
+        std::uint64_t resimulated_frames() const noexcept { return m_resimulated_frames; }
+        // Frames taken from a speculative branch instead
+        std::uint64_t adopted_frames() const noexcept { return m_adopted_frames; }
+
+        desync_dump make_dump() const;
+
+        boost::signals2::signal<void(std::uint64_t, int, input_mask)> on_send_input;
+        boost::signals2::signal<void(std::uint64_t, std::uint64_t)> on_send_checksum;
+        boost::signals2::signal<void(std::uint64_t)> on_desync;
+        // Frame, its confirmed inputs and the state after it, once per confirmed frame
+        boost::signals2::signal<void(std::uint64_t, const frame_input&, const state_buffer&)> on_confirm;
+
+    private:
+        struct pending_input
+        {
+            std::uint64_t frame;
+            int player;
+            input_mask keys;
+        };
+        struct snapshot
+        {
+            std::uint64_t frame = 0; // state before this frame
+            state_buffer state;
+        };
+
+        std::shared_ptr<game_world> m_game;
+        unsigned int m_seed;
+        int m_local_player;
+        unsigned int m_input_delay;
+        unsigned int m_target_delay;
+
+        // Inputs used for every frame since the start, confirmed or predicted
+        std::vector<frame_input> m_inputs;
+        std::vector<std::uint8_t> m_confirmed; // one bit per player
+        std::uint64_t m_confirmed_frames = 0;
+        std::uint64_t m_next_local_frame = 0;
+
+        // States before each of the last max_rollback + 1 frames
+        std::array<snapshot, max_rollback + 1> m_snapshots;
+        std::array<snapshot, dump_depth> m_confirmed_states;
+
+        std::unique_ptr<speculation> m_speculation;
+        std::uint64_t m_speculated_frames = 0; // next frame to push
+        std::uint64_t m_remote_inputs = 0;
+        std::uint64_t m_mispredicted_inputs = 0;
+        std::uint64_t m_resimulated_frames = 0;
+        std::uint64_t m_adopted_frames = 0;
+
+        // Checksum after each confirmed frame
+        std::vector<std::uint64_t> m_checksums;
+        state_hasher m_hasher; // consecutive confirmed states differ little
+        std::map<std::uint64_t, std::uint64_t> m_remote_checksums;
+        std::optional<std::uint64_t> m_desync_frame;
+
+        std::mutex m_mutex;
+        std::vector<pending_input> m_pending_inputs;
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> m_pending_checksums;
+
+        void reserve_frame(std::uint64_t frame);
+        // Returns the earliest simulated frame whose input changed
+        std::uint64_t confirm_input(std::uint64_t frame, int player, input_mask keys);
+        void predict_input(std::uint64_t frame);
+        void simulate_frame(std::uint64_t frame);
+        // The rollback snapshot of the state before frame, which has to be kept
+        const state_buffer& snapshot_before(std::uint64_t frame) const;
+        // Returns the frame to resimulate from
+        std::uint64_t adopt_speculation(std::uint64_t rollback_from, std::uint64_t frame);
+        void update_speculation();
+        void record_checksums();
+        void compare_checksums();
+    };
+}
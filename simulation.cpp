@@ -0,0 +1,65 @@
+#include "simulation.hpp"
+#include <algorithm>
+#include <chrono>
+#include <SDL.h>
+#include "timestep.hpp"
+
+
+namespace awe
+{
+    simulation_thread::~simulation_thread()
+    {
+        stop();
+    }
+
+    void simulation_thread::start(std::shared_ptr<runner> r)
+    {
+        stop();
+        m_ticks = 0;
+        m_thread = std::jthread(
+            [this, r = std::move(r)](std::stop_token stop) { run(stop, r); }
+        );
+    }
+
+    void simulation_thread::stop()
+    {
+        if(!m_thread.joinable())
+            return;
+        m_thread.request_stop();
+        m_thread.join();
+    }
+
+    double simulation_thread::alpha() const noexcept
+    {
+        std::uint64_t now = SDL_GetPerformanceCounter();
+        std::uint64_t origin = m_tick_origin.load(std::memory_order_relaxed);
+        if(now < origin)
+            return 0.0;
+        double a = static_cast<double>(now - origin) / static_cast<double>(m_tick_duration.load(std::memory_order_relaxed));
+        return std::min(a, 1.0);
+    }
+
+    void simulation_thread::run(std::stop_token stop, std::shared_ptr<runner> r)
+    {
+        fixed_timestep timestep;
+        m_tick_duration = timestep.tick_duration();
+        while(!stop.stop_requested())
+        {
+            std::uint64_t now = SDL_GetPerformanceCounter();
+            unsigned int ticks = timestep.advance(now);
+            for(unsigned int i = 0; i < ticks; ++i)
+                r->update();
+            if(ticks > 0)
+            {
+                r->publish();
+                m_ticks.fetch_add(ticks, std::memory_order_relaxed);
+            }
+            std::uint64_t accumulated = static_cast<std::uint64_t>(timestep.alpha() * timestep.tick_duration());
+            m_tick_origin.store(now - accumulated, std::memory_order_relaxed);
+
+            // Sleep until the next tick is due
+            double remaining = (1.0 - timestep.alpha()) / timestep.rate();
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+        }
+    }
+}
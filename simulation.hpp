@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include "runner.hpp"
+
+
+namespace awe
+{
+    //  Runs the runner at the fixed tick rate on its own thread,
+    //  so slow rendering never delays a tick or the processing of inputs
+    class simulation_thread
+    {
+    public:
+        ~simulation_thread();
+
+        void start(std::shared_ptr<runner> r);
+        // Blocks until the thread has finished its current tick
+        void stop();
+
+        bool running() const noexcept { return m_thread.joinable(); }
+
+        // Fraction of the next tick already elapsed, in [0, 1]
+        double alpha() const noexcept;
+        std::uint64_t ticks() const noexcept { return m_ticks.load(std::memory_order_relaxed); }
+
+    private:
+        std::jthread m_thread;
+        std::atomic<std::uint64_t> m_tick_origin = 0; // counter value of the last tick boundary
+        std::atomic<std::uint64_t> m_tick_duration = 1;
+        std::atomic<std::uint64_t> m_ticks = 0;
+
+        void run(std::stop_token stop, std::shared_ptr<runner> r);
+    };
+}
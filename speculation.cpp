@@ -0,0 +1,217 @@
+#include "speculation.hpp"
+#include <algorithm>
+
+
+namespace awe
+{
+    namespace detailed
+    {
+        constexpr std::array<input_mask, speculation::branch_count> guesses = {
+            0,
+            to_mask(cmd::MV_UP),
+            to_mask(cmd::MV_DOWN),
+            to_mask(cmd::MV_LEFT),
+            to_mask(cmd::MV_RIGHT)
+        };
+    }
+
+    speculation::speculation(int local_player, std::size_t max_frames, std::size_t branches)
+        : m_local_player(local_player),
+        m_max_frames(max_frames),
+        m_branch_count(std::min(branches, branch_count))
+    {
+        for(std::size_t i = 0; i < m_branch_count; ++i)
+        {
+            auto& b = m_branches[i];
+            b.guess = detailed::guesses[i];
+            b.thread = std::jthread([&b](std::stop_token stop) { run(stop, b); });
+        }
+    }
+    speculation::~speculation()
+    {
+        // Stop the threads before the branches they use are destroyed
+        for(auto& b : branches())
+        {
+            b.thread.request_stop();
+            b.thread.join();
+        }
+    }
+
+    void speculation::restart(std::uint64_t base, const state_buffer& state, const frame_input& last)
+    {
+        m_active = true;
+        m_base = base;
+        for(auto& b : branches())
+        {
+            std::lock_guard guard(b.mutex);
+            ++b.generation;
+            b.active = !predicted(b, last);
+            b.inputs.clear();
+            b.done = 0;
+            if(b.active)
+                b.base_state = state;
+            b.cv.notify_one();
+        }
+    }
+    void speculation::rebase(
+        std::uint64_t base,
+        std::span<const frame_input> inputs,
+        const frame_input& last,
+        const std::function<const state_buffer&()>& state
+    ) {
+        const std::size_t final_frames = static_cast<std::size_t>(base - m_base);
+        m_base = base;
+        const state_buffer* base_state = nullptr;
+        for(auto& b : branches())
+        {
+            std::lock_guard guard(b.mutex);
+            const bool active = !predicted(b, last);
+            bool kept = active && b.active && b.done >= final_frames && b.inputs.size() == inputs.size();
+            for(std::size_t i = 0; kept && i < final_frames; ++i)
+                kept = b.inputs[i] == inputs[i];
+
+            if(kept)
+            {
+                // The worker carries on where it is, only the indices move.
+                // The states are rotated to reuse their buffers.
+                b.inputs.erase(b.inputs.begin(), b.inputs.begin() + final_frames);
+                std::rotate(b.states.begin(), b.states.begin() + final_frames, b.states.end());
+                b.done -= final_frames;
+                continue;
+            }
+
+            ++b.generation;
+            b.active = active;
+            b.inputs.clear();
+            b.done = 0;
+            if(!b.active)
+                continue;
+            if(!base_state)
+                base_state = &state();
+            b.base_state = *base_state;
+            for(std::size_t i = final_frames; i < inputs.size() && b.inputs.size() < m_max_frames; ++i)
+                b.inputs.push_back(guessed(b, inputs[i]));
+            b.cv.notify_one();
+        }
+    }
+    void speculation::clear()
+    {
+        m_active = false;
+        for(auto& b : branches())
+        {
+            std::lock_guard guard(b.mutex);
+            ++b.generation;
+            b.active = false;
+            b.inputs.clear();
+            b.done = 0;
+        }
+    }
+
+    void speculation::push(const frame_input& input)
+    {
+        for(auto& b : branches())
+        {
+            std::lock_guard guard(b.mutex);
+            if(!b.active || b.inputs.size() >= m_max_frames)
+                continue;
+            b.inputs.push_back(guessed(b, input));
+            b.cv.notify_one();
+        }
+    }
+
+    std::uint64_t speculation::adopt(
+        std::uint64_t from,
+        std::span<const frame_input> inputs,
+        const std::function<void(std::uint64_t, const state_buffer&)>& out
+    ) {
+        if(!m_active || from < m_base)
+            return from;
+
+        branch* best = nullptr;
+        std::size_t best_matched = 0;
+        for(auto& b : branches())
+        {
+            std::unique_lock lock(b.mutex);
+            if(!b.active)
+                continue;
+            std::size_t matched = 0;
+            std::size_t n = std::min(b.done, inputs.size());
+            while(matched < n && b.inputs[matched] == inputs[matched])
+                ++matched;
+            if(matched > best_matched)
+            {
+                best_matched = matched;
+                best = &b;
+            }
+        }
+
+        const std::uint64_t end = m_base + best_matched;
+        if(!best || end <= from)
+            return from;
+
+        // The branch only ever appends, the matched states stay valid
+        std::lock_guard guard(best->mutex);
+        for(std::uint64_t f = from + 1; f <= end; ++f)
+            out(f, best->states[f - m_base - 1]);
+        return end;
+    }
+
+    frame_input speculation::guessed(const branch& b, const frame_input& input) const noexcept
+    {
+        frame_input result = input;
+        for(std::size_t p = 0; p < max_players; ++p)
+        {
+            if(static_cast<int>(p) != m_local_player)
+                result.keys[p] = b.guess;
+        }
+        return result;
+    }
+    bool speculation::predicted(const branch& b, const frame_input& last) const noexcept
+    {
+        for(std::size_t p = 0; p < max_players; ++p)
+        {
+            if(static_cast<int>(p) != m_local_player && last.keys[p] != b.guess)
+                return false;
+        }
+        return true;
+    }
+
+    void speculation::run(std::stop_token stop, branch& b)
+    {
+        game_world world(0);
+        state_buffer scratch;
+        std::uint64_t loaded = 0;
+
+        std::unique_lock lock(b.mutex);
+        for(;;)
+        {
+            if(!b.cv.wait(lock, stop, [&b] { return b.active && b.done < b.inputs.size(); }))
+                return;
+
+            if(loaded != b.generation)
+            {
+                world.load_state(b.base_state);
+                loaded = b.generation;
+            }
+            const std::uint64_t generation = b.generation;
+            const frame_input input = b.inputs[b.done];
+
+            lock.unlock();
+            world.apply_input(input);
+            world.update();
+            world.save_state(scratch);
+            lock.lock();
+
+            if(generation != b.generation)
+            {
+                // Restarted in the meantime, reload on the next frame
+                loaded = 0;
+                continue;
+            }
+            if(b.states.size() <= b.done)
+                b.states.emplace_back();
+            std::swap(b.states[b.done], scratch);
+            ++b.done;
+        }
+    }
+}
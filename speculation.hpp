@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include "game.hpp"
+
+
+namespace awe
+{
+    //  Simulates likely alternatives to the predicted remote input on worker
+    //  threads, one branch per guess: releasing every key or holding a single
+    //  direction. Holding the last input is the prediction of the session
+    //  itself and needs no branch. When a confirmed input proves the
+    //  prediction wrong, the session adopts the states of the branch that
+    //  guessed right instead of resimulating every frame on its own thread.
+    //  Each branch has a thread simulating the whole world, so there should
+    //  be no more branches than idle cores.
+    class speculation
+    {
+    public:
+        static constexpr std::size_t branch_count = 5;
+
+        // Runs the first branches guesses, the likeliest ones first, at
+        // most branch_count. Branches keep at most max_frames states.
+        speculation(int local_player, std::size_t max_frames, std::size_t branches = branch_count);
+        ~speculation();
+
+        // Starts every branch over from the state before frame base.
+        // last is the input of the frame before, which the session repeats.
+        void restart(std::uint64_t base, const state_buffer& state, const frame_input& last);
+        // Moves the base forward once the frames before base are final.
+        // inputs are the final inputs from the old base on, followed by the
+        // ones pushed since. A branch that simulated the final inputs keeps
+        // its states after the new base, the others start over from the
+        // state before base, which state() is only called for if needed.
+        void rebase(
+            std::uint64_t base,
+            std::span<const frame_input> inputs,
+            const frame_input& last,
+            const std::function<const state_buffer&()>& state
+        );
+        // Stops every branch
+        void clear();
+        // Queues the next frame, only the local keys are used
+        void push(const frame_input& input);
+
+        bool active() const noexcept { return m_active; }
+        std::uint64_t base() const noexcept { return m_base; }
+
+        // inputs are the final inputs from the base frame on.
+        // Calls out(frame, state before frame) for every frame after from
+        // whose state a branch has simulated with exactly these inputs.
+        // Returns the last of those frames, or from if there are none.
+        std::uint64_t adopt(
+            std::uint64_t from,
+            std::span<const frame_input> inputs,
+            const std::function<void(std::uint64_t, const state_buffer&)>& out
+        );
+
+    private:
+        struct branch
+        {
+            std::mutex mutex;
+            std::condition_variable_any cv;
+            bool active = false;
+            std::uint64_t generation = 0;
+            input_mask guess = 0;
+            state_buffer base_state;
+            // Inputs from the base frame on, with the guess for remote players
+            std::vector<frame_input> inputs;
+            // states[i] is the state after frame base + i
+            std::vector<state_buffer> states;
+            std::size_t done = 0;
+            std::jthread thread;
+        };
+
+        int m_local_player;
+        std::size_t m_max_frames;
+        bool m_active = false;
+        std::uint64_t m_base = 0;
+        std::array<branch, branch_count> m_branches;
+        std::size_t m_branch_count;
+
+        std::span<branch> branches() noexcept { return std::span(m_branches).first(m_branch_count); }
+        // The input with the guess of b for the remote players
+        frame_input guessed(const branch& b, const frame_input& input) const noexcept;
+        // Holding the last input is the prediction of the session
+        bool predicted(const branch& b, const frame_input& last) const noexcept;
+
+        static void run(std::stop_token stop, branch& b);
+    };
+}
@@ -0,0 +1,77 @@
+#include "sprite_batch.hpp"
+#include <algorithm>
+#include <numeric>
+
+
+namespace awe
+{
+    render_stats sprite_batch::flush(SDL_Renderer* ren)
+    {
+        render_stats stats;
+        const std::size_t n = m_sprites.size();
+        if(n == 0)
+            return stats;
+
+        // Ties keep the order of add() so overlapping sprites don't flicker
+        m_order.resize(n);
+        std::iota(m_order.begin(), m_order.end(), 0u);
+        std::sort(m_order.begin(), m_order.end(), [this](std::uint32_t lhs, std::uint32_t rhs) {
+            const sprite& a = m_sprites[lhs];
+            const sprite& b = m_sprites[rhs];
+            if(a.layer != b.layer)
+                return a.layer < b.layer;
+            if(a.texture != b.texture)
+                return std::less<SDL_Texture*>()(a.texture, b.texture);
+            return lhs < rhs;
+        });
+
+        m_vertices.resize(n * 4);
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            const sprite& s = m_sprites[m_order[i]];
+            const float x0 = s.dst.x, y0 = s.dst.y;
+            const float x1 = s.dst.x + s.dst.w, y1 = s.dst.y + s.dst.h;
+            const float u0 = s.uv.x, v0 = s.uv.y;
+            const float u1 = s.uv.x + s.uv.w, v1 = s.uv.y + s.uv.h;
+            SDL_Vertex* v = &m_vertices[i * 4];
+            v[0] = { { x0, y0 }, s.color, { u0, v0 } };
+            v[1] = { { x1, y0 }, s.color, { u1, v0 } };
+            v[2] = { { x1, y1 }, s.color, { u1, v1 } };
+            v[3] = { { x0, y1 }, s.color, { u0, v1 } };
+        }
+        for(std::size_t q = m_indices.size() / 6; q < n; ++q)
+        {
+            const int base = static_cast<int>(q * 4);
+            for(int i : { 0, 1, 2, 2, 3, 0 })
+                m_indices.push_back(base + i);
+        }
+
+        // A run may cross into the next layer, the quads of a call are
+        // still drawn in the sorted order
+        for(std::size_t first = 0; first < n;)
+        {
+            SDL_Texture* tex = m_sprites[m_order[first]].texture;
+            std::size_t last = first + 1;
+            while(last < n && m_sprites[m_order[last]].texture == tex)
+                ++last;
+
+            const std::size_t quads = last - first;
+            SDL_RenderGeometry(
+                ren,
+                tex,
+                m_vertices.data() + first * 4,
+                static_cast<int>(quads * 4),
+                m_indices.data(),
+                static_cast<int>(quads * 6)
+            );
+            ++stats.draw_calls;
+            first = last;
+        }
+
+        stats.sprites = static_cast<std::uint32_t>(n);
+        stats.vertices = static_cast<std::uint32_t>(n * 4);
+        stats.indices = static_cast<std::uint32_t>(n * 6);
+        m_sprites.clear();
+        return stats;
+    }
+}
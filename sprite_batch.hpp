@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <SDL.h>
+
+
+namespace awe
+{
+    // Work done by the renderer for one frame
+    struct render_stats
+    {
+        std::uint32_t draw_calls = 0;
+        std::uint32_t sprites = 0;
+        std::uint32_t vertices = 0;
+        std::uint32_t indices = 0;
+    };
+
+    //  Collects the quads of a frame and draws them with as few
+    //  SDL_RenderGeometry calls as possible. The quads are sorted by layer,
+    //  then by texture, and each run of quads sharing a texture is a single
+    //  call over one vertex and index buffer for the whole frame.
+    class sprite_batch
+    {
+    public:
+        struct sprite
+        {
+            SDL_Texture* texture = nullptr; // a solid color if nullptr
+            std::int32_t layer = 0; // drawn from the lowest
+            SDL_FRect dst{};
+            SDL_FRect uv{ 0.0f, 0.0f, 1.0f, 1.0f }; // normalized texture coordinates
+            SDL_Color color{ 255, 255, 255, 255 };
+        };
+
+        void reserve(std::size_t sprites) { m_sprites.reserve(sprites); }
+        void add(const sprite& s) { m_sprites.push_back(s); }
+
+        // Draws the collected sprites and starts a new batch
+        render_stats flush(SDL_Renderer* ren);
+
+    private:
+        std::vector<sprite> m_sprites;
+        std::vector<std::uint32_t> m_order;
+        std::vector<SDL_Vertex> m_vertices;
+        // 0, 1, 2, 2, 3, 0 for every quad, offset by 4 each, only grows
+        std::vector<int> m_indices;
+    };
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <boost/endian.hpp>
+
+
+namespace awe
+{
+    typedef std::vector<std::byte> state_buffer;
+
+    // Serializes the game state as little-endian integers, so the bytes
+    // (and the checksum over them) are the same on every platform
+    class state_writer
+    {
+    public:
+        explicit state_writer(state_buffer& buf) noexcept
+            : m_buf(buf) {}
+
+        template <typename T>
+        void write(T val)
+        {
+            static_assert(std::is_integral_v<T>);
+            val = boost::endian::native_to_little(val);
+            write_bytes(&val, sizeof(val));
+        }
+
+        void write_bytes(const void* data, std::size_t len)
+        {
+            auto* p = static_cast<const std::byte*>(data);
+            m_buf.insert(m_buf.end(), p, p + len);
+        }
+
+        // A single copy on little-endian hosts.
+        // T is an integer or a fixed-point type.
+        template <typename T>
+        void write_array(const T* data, std::size_t n)
+        {
+            if constexpr(boost::endian::order::native == boost::endian::order::little)
+                write_bytes(data, n * sizeof(T));
+            else
+            {
+                for(std::size_t i = 0; i < n; ++i)
+                {
+                    if constexpr(std::is_integral_v<T>)
+                        write(data[i]);
+                    else
+                        write(data[i].raw());
+                }
+            }
+        }
+
+    private:
+        state_buffer& m_buf;
+    };
+
+    class state_reader
+    {
+    public:
+        explicit state_reader(std::span<const std::byte> buf) noexcept
+            : m_buf(buf) {}
+
+        template <typename T>
+        T read()
+        {
+            static_assert(std::is_integral_v<T>);
+            T val;
+            read_bytes(&val, sizeof(val));
+            return boost::endian::little_to_native(val);
+        }
+
+        void read_bytes(void* out, std::size_t len)
+        {
+            if(m_buf.size() - m_pos < len)
+                throw std::out_of_range("state buffer too short");
+            std::memcpy(out, m_buf.data() + m_pos, len);
+            m_pos += len;
+        }
+
+        template <typename T>
+        void read_array(T* out, std::size_t n)
+        {
+            if constexpr(boost::endian::order::native == boost::endian::order::little)
+                read_bytes(out, n * sizeof(T));
+            else
+            {
+                for(std::size_t i = 0; i < n; ++i)
+                {
+                    if constexpr(std::is_integral_v<T>)
+                        out[i] = read<T>();
+                    else
+                        out[i] = T::from_raw(read<typename T::raw_type>());
+                }
+            }
+        }
+
+        // Rejects a count of elements the rest of the buffer can't hold,
+        // so a corrupt count fails here instead of in the caller's allocation
+        std::size_t check_count(std::uint64_t n, std::size_t element_size) const
+        {
+            if(element_size > 0 && n > remaining() / element_size)
+                throw std::out_of_range("state buffer too short");
+            return static_cast<std::size_t>(n);
+        }
+
+        std::size_t remaining() const noexcept { return m_buf.size() - m_pos; }
+
+    private:
+        std::span<const std::byte> m_buf;
+        std::size_t m_pos = 0;
+    };
+
+    // 64-bit FNV-1a
+    constexpr std::uint64_t fnv1a(
+        std::span<const std::byte> data,
+        std::uint64_t hash = 14695981039346656037ull
+    ) noexcept {
+        for(std::byte b : data)
+        {
+            hash ^= static_cast<std::uint64_t>(b);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+namespace awe
+{
+    //  Per-tick durations of a run
+    class tick_stats
+    {
+    public:
+        void reserve(std::size_t n) { m_samples.reserve(n); }
+        void add(std::uint64_t ns) { m_samples.push_back(ns); m_total += ns; }
+        void clear() noexcept { m_samples.clear(); m_total = 0; }
+
+        std::size_t count() const noexcept { return m_samples.size(); }
+        // Sum of the tick durations in nanoseconds
+        std::uint64_t total() const noexcept { return m_total; }
+
+        double ticks_per_second() const noexcept
+        {
+            return m_total == 0 ? 0.0 : count() * 1e9 / static_cast<double>(m_total);
+        }
+
+        // p in [0, 100], nearest rank
+        std::uint64_t percentile(double p) const
+        {
+            if(m_samples.empty())
+                return 0;
+            std::vector<std::uint64_t> sorted = m_samples;
+            std::size_t rank = static_cast<std::size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            return sorted[rank];
+        }
+
+    private:
+        std::vector<std::uint64_t> m_samples;
+        std::uint64_t m_total = 0;
+    };
+}
@@ -0,0 +1,76 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+
+namespace awe
+{
+    thread_pool::thread_pool(unsigned int threads)
+    {
+        m_workers.reserve(std::max(threads, 1u) - 1);
+        for(unsigned int i = 1; i < threads; ++i)
+            m_workers.emplace_back([this](std::stop_token stop) { run(stop); });
+    }
+    thread_pool::~thread_pool()
+    {
+        for(auto& w : m_workers)
+            w.request_stop();
+        m_workers.clear();
+    }
+
+    void thread_pool::parallel_for(std::size_t count, const std::function<void(std::size_t)>& f)
+    {
+        if(m_workers.empty() || count <= 1)
+        {
+            for(std::size_t i = 0; i < count; ++i)
+                f(i);
+            return;
+        }
+
+        std::lock_guard run_guard(m_run_mutex);
+        {
+            std::lock_guard guard(m_mutex);
+            m_job = &f;
+            m_count = count;
+            m_next = 0;
+            ++m_generation;
+        }
+        m_cv.notify_all();
+
+        work();
+
+        std::unique_lock lock(m_mutex);
+        m_done_cv.wait(lock, [this] { return m_busy == 0; });
+        m_job = nullptr;
+    }
+
+    void thread_pool::run(std::stop_token stop)
+    {
+        std::uint64_t seen = 0;
+        std::unique_lock lock(m_mutex);
+        for(;;)
+        {
+            if(!m_cv.wait(lock, stop, [&] { return m_job && m_generation != seen; }))
+                return;
+            seen = m_generation;
+            ++m_busy;
+            lock.unlock();
+
+            work();
+
+            lock.lock();
+            if(--m_busy == 0)
+                m_done_cv.notify_one();
+        }
+    }
+
+    void thread_pool::work()
+    {
+        for(;;)
+        {
+            std::size_t i = m_next.fetch_add(1, std::memory_order_relaxed);
+            if(i >= m_count)
+                return;
+            (*m_job)(i);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace awe
+{
+    //  Fork-join pool for the simulation.
+    //  The calling thread works too, so a pool of n threads has n - 1 workers.
+    class thread_pool
+    {
+    public:
+        explicit thread_pool(unsigned int threads);
+        ~thread_pool();
+
+        unsigned int size() const noexcept { return static_cast<unsigned int>(m_workers.size()) + 1; }
+
+        // Calls f(i) for every i in [0, count) and returns once all calls
+        // have returned. The thread running a call is unspecified, so the
+        // result of a call must only depend on i.
+        // Calls from several threads are serialized.
+        void parallel_for(std::size_t count, const std::function<void(std::size_t)>& f);
+
+    private:
+        std::vector<std::jthread> m_workers;
+
+        std::mutex m_run_mutex;
+        std::mutex m_mutex;
+        std::condition_variable_any m_cv;
+        std::condition_variable m_done_cv;
+        const std::function<void(std::size_t)>* m_job = nullptr;
+        std::size_t m_count = 0;
+        std::uint64_t m_generation = 0;
+        unsigned int m_busy = 0;
+        std::atomic<std::size_t> m_next = 0;
+
+        void run(std::stop_token stop);
+        void work();
+    };
+
+    // Bounds of the i-th of parts contiguous ranges covering [0, n)
+    constexpr std::pair<std::size_t, std::size_t> partition_range(
+        std::size_t n,
+        std::size_t parts,
+        std::size_t i
+    ) noexcept {
+        return { n * i / parts, n * (i + 1) / parts };
+    }
+}
@@ -0,0 +1,40 @@
+#include "timestep.hpp"
+#include <SDL.h>
+
+
+namespace awe
+{
+    fixed_timestep::fixed_timestep(unsigned int rate, unsigned int max_catch_up)
+        : m_rate(rate),
+        m_max_catch_up(max_catch_up),
+        m_freq(SDL_GetPerformanceFrequency())
+    {
+        m_tick = m_freq / m_rate;
+    }
+
+    unsigned int fixed_timestep::advance()
+    {
+        return advance(SDL_GetPerformanceCounter());
+    }
+
+    unsigned int fixed_timestep::advance(std::uint64_t now)
+    {
+        if(!m_started)
+        {
+            m_started = true;
+            m_last = now;
+            m_accumulator = 0;
+            return 0;
+        }
+
+        m_accumulator += now - m_last;
+        m_last = now;
+
+        std::uint64_t ticks = m_accumulator / m_tick;
+        m_accumulator -= ticks * m_tick;
+        if(ticks > m_max_catch_up)
+            ticks = m_max_catch_up;
+
+        return static_cast<unsigned int>(ticks);
+    }
+}
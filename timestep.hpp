@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+
+namespace awe
+{
+    //  Accumulator driving the simulation at a fixed tick rate,
+    //  independent of the display refresh rate
+    class fixed_timestep
+    {
+    public:
+        static constexpr unsigned int default_rate = 60;
+        // Ticks simulated at most per call, the rest of a long stall is dropped
+        static constexpr unsigned int default_max_catch_up = 5;
+
+        explicit fixed_timestep(
+            unsigned int rate = default_rate,
+            unsigned int max_catch_up = default_max_catch_up
+        );
+
+        // Returns the number of ticks to simulate since the last call
+        unsigned int advance();
+        // Same with an explicit SDL_GetPerformanceCounter() value
+        unsigned int advance(std::uint64_t now);
+
+        // Fraction of the next tick that has already elapsed, in [0, 1)
+        double alpha() const noexcept
+        {
+            return static_cast<double>(m_accumulator) / static_cast<double>(m_tick);
+        }
+
+        // Restarts the accumulation on the next call
+        void reset() noexcept
+        {
+            m_started = false;
+            m_accumulator = 0;
+        }
+
+        unsigned int rate() const noexcept { return m_rate; }
+        // Duration of a tick in performance counter units
+        std::uint64_t tick_duration() const noexcept { return m_tick; }
+        std::uint64_t frequency() const noexcept { return m_freq; }
+
+    private:
+        unsigned int m_rate;
+        unsigned int m_max_catch_up;
+        std::uint64_t m_freq;
+        std::uint64_t m_tick;
+        std::uint64_t m_last = 0;
+        std::uint64_t m_accumulator = 0;
+        bool m_started = false;
+    };
+}
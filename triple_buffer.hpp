@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+namespace awe
+{
+    //  Lock-free single producer, single consumer triple buffer.
+    //  The writer fills back() and publishes it, the reader always gets the
+    //  newest published value. Neither side ever waits for the other.
+    template <typename T>
+    class triple_buffer
+    {
+    public:
+        // Writer side
+        T& back() noexcept { return m_buffers[m_back]; }
+        void publish() noexcept
+        {
+            m_back = m_middle.exchange(m_back | dirty_bit, std::memory_order_acq_rel) & index_mask;
+        }
+
+        // Reader side, the value stays untouched until the next call
+        const T& read() noexcept
+        {
+            if(m_middle.load(std::memory_order_relaxed) & dirty_bit)
+                m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & index_mask;
+            return m_buffers[m_front];
+        }
+        // Reader side, the value returned by the last read()
+        const T& front() const noexcept { return m_buffers[m_front]; }
+        bool has_new() const noexcept
+        {
+            return m_middle.load(std::memory_order_relaxed) & dirty_bit;
+        }
+
+    private:
+        static constexpr std::uint8_t dirty_bit = 4;
+        static constexpr std::uint8_t index_mask = 3;
+
+        std::array<T, 3> m_buffers{};
+        std::atomic<std::uint8_t> m_middle = 1;
+        std::uint8_t m_back = 0; // only touched by the writer
+        std::uint8_t m_front = 2; // only touched by the reader
+    };
+}
@@ -1,8 +1,13 @@
 #include "widgets.hpp"
+#include <algorithm>
 #include <imgui.h>
 #include "main.hpp"
 #include "network.hpp"
 #include "game.hpp"
+#include "delay_controller.hpp"
+#include "replay.hpp"
+#include "runner.hpp"
+#include "timestep.hpp"
 
 
 namespace awe
@@ -71,7 +76,111 @@ namespace awe
     }
     void mode_panel::replay_tab()
     {
+        ImGui::Checkbox("Record network games", &m_record_replays);
+        ImGui::TextDisabled("Saved to %s", replay_directory().string().c_str());
+        ImGui::Separator();
 
+        if(m_replay_dir.empty())
+            m_replay_dir = replay_directory();
+        if(!m_replays_listed)
+            list_replays();
+        ImGui::Text("%s", m_replay_dir.string().c_str());
+        ImGui::SameLine();
+        if(ImGui::Button("Browse..."))
+        {
+            m_replay_browser.SetTitle("Replay directory");
+            std::error_code ec;
+            if(std::filesystem::is_directory(m_replay_dir, ec))
+                m_replay_browser.SetPwd(m_replay_dir);
+            m_replay_browser.Open();
+        }
+        m_replay_browser.Display();
+        if(m_replay_browser.HasSelected())
+        {
+            m_replay_dir = m_replay_browser.GetSelected();
+            m_replay_browser.ClearSelected();
+            list_replays();
+        }
+
+        const int flags =
+            ImGuiTableFlags_RowBg |
+            ImGuiTableFlags_BordersInnerV |
+            ImGuiTableFlags_ScrollY;
+        if(ImGui::BeginTable("##replays", 5, flags, ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 8)))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Date");
+            ImGui::TableSetupColumn("Length");
+            ImGui::TableSetupColumn("Players");
+            ImGui::TableSetupColumn("Seed");
+            ImGui::TableSetupColumn("Checksum");
+            ImGui::TableHeadersRow();
+
+            // Only the visible rows are formatted
+            const auto& entries = m_replays.entries();
+            ImGuiListClipper clipper;
+            clipper.Begin(static_cast<int>(entries.size()));
+            while(clipper.Step())
+            {
+                for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+                {
+                    const auto& meta = entries[i].meta;
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::PushID(i);
+                    const std::string date = format_replay_date(meta.date);
+                    if(ImGui::Selectable(date.c_str(), i == m_replay_index, ImGuiSelectableFlags_SpanAllColumns))
+                        m_replay_index = i;
+                    if(ImGui::IsItemHovered())
+                        ImGui::SetTooltip("%s", entries[i].path.filename().string().c_str());
+                    ImGui::PopID();
+
+                    ImGui::TableNextColumn();
+                    if(meta.complete)
+                    {
+                        const std::uint64_t seconds = meta.frames / fixed_timestep::default_rate;
+                        ImGui::Text("%llu:%02llu", static_cast<unsigned long long>(seconds / 60), static_cast<unsigned long long>(seconds % 60));
+                    }
+                    else
+                        ImGui::TextDisabled("unfinished");
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%u", meta.info.players);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%u", meta.info.seed);
+                    ImGui::TableNextColumn();
+                    if(meta.checksum)
+                        ImGui::Text("%016llx", static_cast<unsigned long long>(*meta.checksum));
+                    else
+                        ImGui::TextDisabled("-");
+                }
+            }
+            ImGui::EndTable();
+        }
+        if(ImGui::Button("Refresh"))
+            list_replays();
+        ImGui::SameLine();
+        ImGui::BeginDisabled(m_replay_index < 0);
+        if(ImGui::Button("Play"))
+        {
+            if(application::instance().start_replay(m_replays.entries()[m_replay_index].path))
+            {
+                m_mode = MODE_REPLAY;
+                ImGui::CloseCurrentPopup();
+            }
+        }
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::TextDisabled(
+            "%zu replays, %zu headers read",
+            m_replays.entries().size(),
+            m_replays.headers_read()
+        );
+    }
+    void mode_panel::list_replays()
+    {
+        m_replays_listed = true;
+        m_replay_index = -1;
+        m_replays.refresh(m_replay_dir);
     }
     void mode_panel::client_tab()
     {
@@ -82,6 +191,7 @@ namespace awe
         ImGui::BeginDisabled(freeze_ui());
         ImGui::InputText("IP", m_ip, 16);
         ImGui::InputInt("Port", &m_port);
+        ImGui::Checkbox("Speculate on idle cores", &m_speculate);
         ImGui::EndDisabled();
         switch(m_status)
         {
@@ -167,6 +277,7 @@ namespace awe
 
         ImGui::BeginDisabled(freeze_ui());
         ImGui::InputInt("Port", &m_port);
+        ImGui::Checkbox("Speculate on idle cores", &m_speculate);
         ImGui::EndDisabled();
         switch(m_status)
         {
@@ -358,6 +469,18 @@ namespace awe
             return;
         }
 
+        if(gc.m_delay_controller)
+        {
+            auto status = gc.m_delay_controller->get_status();
+            ImGui::Text("Input delay: %u (target %u)", status.delay, status.target);
+            if(status.measured)
+                ImGui::Text("RTT: %.1f ms (jitter %.1f ms)", status.rtt_ms, status.jitter_ms);
+            else
+                ImGui::Text("RTT: measuring");
+            ImGui::Text("Mispredicted: %.1f%%", status.misprediction_rate * 100.0);
+            ImGui::Separator();
+        }
+
         if(ImGui::Button("Stop"))
         {
             gc.on_stop();
@@ -366,6 +489,76 @@ namespace awe
         ImGui::End();
     }
 
+    replay_control::~replay_control() = default;
+
+    void ShowReplayControl(const char* title, replay_control& rc)
+    {
+        const int flags =
+            ImGuiWindowFlags_NoSavedSettings |
+            ImGuiWindowFlags_AlwaysAutoResize;
+        if(!ImGui::Begin(title, nullptr, flags))
+        {
+            ImGui::End();
+            return;
+        }
+
+        // Stopping releases the runner of the control
+        auto runner = rc.m_runner;
+        if(runner)
+        {
+            const auto& info = runner->file().info();
+            ImGui::Text("Seed %u, %u players", info.seed, info.players);
+            if(runner->failed())
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", runner->error().c_str());
+
+            std::uint64_t frame = runner->frame();
+            const std::uint64_t first = 0, last = runner->frames();
+            ImGui::SetNextItemWidth(320.0f);
+            if(ImGui::SliderScalar("Frame", ImGuiDataType_U64, &frame, &first, &last))
+                runner->seek(frame);
+
+            const char* const speeds_name[] = { "1x", "2x", "4x", "8x", "16x", "Unlimited" };
+            const unsigned int speeds[] = { 1, 2, 4, 8, 16, 0 };
+            int speed_id = 0;
+            while(speed_id + 1 < static_cast<int>(std::size(speeds)) && speeds[speed_id] != runner->speed())
+                ++speed_id;
+            ImGui::SetNextItemWidth(120.0f);
+            if(ImGui::Combo("Speed", &speed_id, speeds_name, static_cast<int>(std::size(speeds_name))))
+                runner->set_speed(speeds[speed_id]);
+
+            bool paused = runner->paused();
+            if(ImGui::Checkbox("Pause", &paused))
+                runner->set_paused(paused);
+            ImGui::Separator();
+        }
+
+        if(ImGui::Button("Stop"))
+        {
+            rc.on_stop();
+        }
+
+        ImGui::End();
+    }
+
+    void ShowRenderStats(const char* title, const render_stats& stats)
+    {
+        const int flags =
+            ImGuiWindowFlags_NoSavedSettings |
+            ImGuiWindowFlags_AlwaysAutoResize;
+        if(!ImGui::Begin(title, nullptr, flags))
+        {
+            ImGui::End();
+            return;
+        }
+
+        ImGui::Text("Draw calls: %u", stats.draw_calls);
+        ImGui::Text("Sprites: %u", stats.sprites);
+        ImGui::Text("Vertices: %u", stats.vertices);
+        ImGui::Text("Indices: %u", stats.indices);
+
+        ImGui::End();
+    }
+
     start_panel::start_panel()
     {
         set(0, false);
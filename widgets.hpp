@@ -1,5 +1,6 @@
 #pragma once
 
+#include <filesystem>
 #include <mutex>
 #include <future>
 #include <memory>
@@ -8,6 +9,10 @@
 #include <map>
 #include <boost/system.hpp>
 #include <boost/signals2.hpp>
+#include <imgui.h>
+#include <imfilebrowser.h>
+#include "replay_library.hpp"
+#include "sprite_batch.hpp"
 
 
 namespace awe
@@ -44,7 +49,7 @@ namespace awe
 
         bool selected() const
         {
-            return get_network_status() == CONNECTED;
+            return get_network_status() == CONNECTED || m_mode == MODE_REPLAY;
         }
         void reset_network()
         {
@@ -57,6 +62,11 @@ namespace awe
             return m_mode;
         }
 
+        bool record_replays() const noexcept { return m_record_replays; }
+        bool speculate() const noexcept { return m_speculate; }
+        // Back to the mode selection when a replay is stopped
+        void reset_replay() { m_mode = MODE_NONE; }
+
     private:
         std::shared_ptr<network> m_network;
         std::future<boost::system::error_code> m_network_result;
@@ -70,6 +80,13 @@ namespace awe
 
         int m_mode_id = 0;
         mode m_mode = MODE_NONE;
+        bool m_record_replays = true;
+        bool m_speculate = true;
+        replay_library m_replays;
+        std::filesystem::path m_replay_dir;
+        ImGui::FileBrowser m_replay_browser{ ImGuiFileBrowserFlags_SelectDirectory };
+        int m_replay_index = -1;
+        bool m_replays_listed = false;
         void local_single_tab();
         void local_double_tab();
         void replay_tab();
@@ -77,6 +94,7 @@ namespace awe
         void server_tab();
 
         bool freeze_ui() const noexcept;
+        void list_replays();
     };
 
     class chatroom
@@ -160,6 +178,7 @@ namespace awe
     };
 
     class game_world;
+    class delay_controller;
 
     class game_control
     {
@@ -172,10 +191,39 @@ namespace awe
         {
             m_game_world.swap(ptr);
         }
+        // Network games only
+        void set_delay_controller(std::shared_ptr<const delay_controller> ptr)
+        {
+            m_delay_controller.swap(ptr);
+        }
 
         boost::signals2::signal<void()> on_stop;
 
     private:
         std::shared_ptr<game_world> m_game_world;
+        std::shared_ptr<const delay_controller> m_delay_controller;
     };
+
+    class replay_runner;
+
+    class replay_control
+    {
+    public:
+        ~replay_control();
+
+        friend void ShowReplayControl(const char* title, replay_control& rc);
+
+        void set_runner(std::shared_ptr<replay_runner> ptr)
+        {
+            m_runner.swap(ptr);
+        }
+
+        boost::signals2::signal<void()> on_stop;
+
+    private:
+        std::shared_ptr<replay_runner> m_runner;
+    };
+
+    // Work of the last rendered frame
+    void ShowRenderStats(const char* title, const render_stats& stats);
 }